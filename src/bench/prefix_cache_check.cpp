@@ -0,0 +1,90 @@
+/// \file prefix_cache_check.cpp
+/// \brief on-device check that prefix reuse generates what a full reset does
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Usage: prefix_cache_check <model_list.json> <models_dir> <model_tag> [max_tokens]
+/// \note Each case runs greedy decoding twice on the same prompt, once through insert_with_prefix_cache after an
+///       earlier turn and once after clear_context(), and fails if the two outputs differ. The exit code is 1 on a mismatch.
+#include "chat/chat_bot.hpp"
+#include "model_list.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+/// \brief one comparison
+typedef struct {
+    const char* name;
+    const char* first_turn;
+    const char* second_turn;
+    bool keep_reply;
+} prefix_case_t;
+
+/// \brief generate greedily from a conversation
+/// \param bot the chat bot
+/// \param messages the conversation
+/// \param max_tokens the generation limit
+/// \param cached_tokens the tokens reused from the KV cache
+/// \return the generated text
+std::string run_turn(chat_bot& bot, nlohmann::ordered_json& messages, int max_tokens, size_t& cached_tokens) {
+    chat_meta_info meta_info;
+    std::vector<int> tokens = bot.tokenize(messages, true);
+    std::ostringstream os;
+    std::string text = bot.generate_with_prompt(meta_info, tokens, max_tokens, os);
+    cached_tokens = meta_info.cached_tokens;
+    return text;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::fprintf(stderr, "Usage: %s <model_list.json> <models_dir> <model_tag> [max_tokens]\n", argv[0]);
+        return 2;
+    }
+    int max_tokens = argc > 4 ? std::atoi(argv[4]) : 64;
+    std::string list_path = argv[1];
+    std::string models_dir = argv[2];
+    std::string tag = argv[3];
+    model_list models(list_path, models_dir);
+    chat_bot bot(0);
+    bot.load_model(models.get_model_path(tag), models.get_model_info(tag));
+    bot.set_topk(1);
+    bot.set_seed(0);
+
+    // A follow-up keeps the whole first turn, an edit rewinds into the middle of it
+    const prefix_case_t cases[] = {
+        {"follow-up", "Tell me a short story about a fox.", "Now give the story a title.", true},
+        {"edited question", "Tell me a short story about a fox.", "Tell me a short story about a crow.", false},
+    };
+    bool all_match = true;
+    for (const prefix_case_t& c : cases) {
+        nlohmann::ordered_json messages = nlohmann::ordered_json::array();
+        messages.push_back({{"role", "user"}, {"content", c.first_turn}});
+        bot.clear_context();
+        size_t cached_tokens = 0;
+        std::string reply = run_turn(bot, messages, max_tokens, cached_tokens);
+        if (c.keep_reply) {
+            messages.push_back({{"role", "assistant"}, {"content", reply}});
+            messages.push_back({{"role", "user"}, {"content", c.second_turn}});
+        } else {
+            messages.back()["content"] = c.second_turn;
+        }
+
+        std::string rewound = run_turn(bot, messages, max_tokens, cached_tokens);
+        size_t reused = cached_tokens;
+        bot.clear_context();
+        std::string reset = run_turn(bot, messages, max_tokens, cached_tokens);
+
+        size_t same = 0;
+        while (same < rewound.size() && same < reset.size() && rewound[same] == reset[same]) {
+            same++;
+        }
+        bool match = rewound == reset;
+        all_match = all_match && match;
+        std::printf("%-16s reused %5zu tokens, %s", c.name, reused, match ? "match\n" : "MISMATCH");
+        if (!match) {
+            std::printf(" at byte %zu\n  rewound: %s\n  reset:   %s\n", same, rewound.c_str(), reset.c_str());
+        }
+    }
+    return all_match ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+/// \file q4nx_dequant_bench.cpp
+/// \brief microbenchmark of the Q4NX dequantization kernels
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Usage: q4nx_dequant_bench [rows] [columns] [threads] [iterations]
+/// \note GB/s counts the packed weights, scales and zero points read plus the bf16 written.
+/// \note Every kernel is checked bit for bit against Q4NX::q4nx_dequantize<bf16>, the exit code is 1 on a mismatch.
+#include "tensor_utils/q4nx_kernels.hpp"
+#include "tensor_utils/q4_npu_eXpress.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+/// \brief best time of a kernel over the iterations
+/// \return the time in seconds
+double time_kernel(std::vector<bf16>& weight, const std::vector<u32>& q, const std::vector<bf16>& scale, const std::vector<i32>& zero_point,
+                   int threads, q4nx_isa_t isa, int iterations) {
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        q4nx_dequantize_bf16(weight.data(), q.data(), scale.data(), zero_point.data(), weight.size(), threads, isa);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    size_t rows = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4096;
+    size_t columns = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4096;
+    int threads = argc > 3 ? std::atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+    int iterations = argc > 4 ? std::atoi(argv[4]) : 20;
+    threads = std::max(threads, 1);
+    iterations = std::max(iterations, 1);
+    if (rows == 0 || columns == 0 || columns % Q4NX_GROUP_SIZE != 0) {
+        std::fprintf(stderr, "columns must be a multiple of %zu\n", Q4NX_GROUP_SIZE);
+        return 1;
+    }
+
+    size_t count = rows * columns;
+    size_t groups = count / Q4NX_GROUP_SIZE;
+    std::mt19937 rng(42);
+    std::vector<u32> q(count / 8);
+    std::vector<bf16> scale(groups);
+    std::vector<i32> zero_point(groups);
+    for (auto& word : q) {
+        word = rng();
+    }
+    std::uniform_real_distribution<float> scale_dist(1e-4f, 1e-1f);
+    for (size_t g = 0; g < groups; g++) {
+        scale[g] = bf16(scale_dist(rng));
+        zero_point[g] = (i32)(rng() % 16);
+    }
+    double gigabytes = (q.size() * sizeof(u32) + groups * (sizeof(bf16) + sizeof(i32)) + count * sizeof(bf16)) / 1e9;
+
+    // The reference is the dequantization Q4NX itself uses
+    buffer<bf16> reference(count);
+    buffer<u32> q_view(q);
+    buffer<bf16> scale_view(scale);
+    buffer<i32> zero_point_view(zero_point);
+    auto start = std::chrono::steady_clock::now();
+    Q4NX::q4nx_dequantize<bf16>(reference, q_view, scale_view, zero_point_view, (int)columns);
+    double q4nx_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<bf16> weight(count);
+    double scalar_seconds = time_kernel(weight, q, scale, zero_point, 1, Q4NX_ISA_SCALAR, iterations);
+    bool all_match = true;
+
+    std::printf("Q4NX dequantize %zu x %zu, group %zu, best of %d, detected ISA %s\n",
+                rows, columns, Q4NX_GROUP_SIZE, iterations, q4nx_isa_name(q4nx_detect_isa()));
+    std::printf("%-8s %8s %10s %10s %9s %6s\n", "isa", "threads", "ms", "GB/s", "speedup", "match");
+    std::printf("%-8s %8d %10.3f %10.2f %8.2fx %6s\n", "Q4NX", 1, q4nx_seconds * 1e3,
+                gigabytes / q4nx_seconds, scalar_seconds / q4nx_seconds, "ref");
+    for (q4nx_isa_t isa : {Q4NX_ISA_SCALAR, Q4NX_ISA_AVX2, Q4NX_ISA_AVX512}) {
+        if (!q4nx_isa_supported(isa)) {
+            std::printf("%-8s %8s\n", q4nx_isa_name(isa), "n/a");
+            continue;
+        }
+        std::vector<int> thread_counts = {1};
+        if (threads > 1) {
+            thread_counts.push_back(threads);
+        }
+        for (int t : thread_counts) {
+            double seconds = scalar_seconds;
+            if (isa != Q4NX_ISA_SCALAR || t != 1) {
+                std::fill(weight.begin(), weight.end(), bf16());
+                seconds = time_kernel(weight, q, scale, zero_point, t, isa, iterations);
+            }
+            bool match = std::memcmp(weight.data(), reference.data(), count * sizeof(bf16)) == 0;
+            all_match = all_match && match;
+            std::printf("%-8s %8d %10.3f %10.2f %8.2fx %6s\n", q4nx_isa_name(isa), t, seconds * 1e3,
+                        gigabytes / seconds, scalar_seconds / seconds, match ? "yes" : "NO");
+        }
+    }
+    return all_match ? 0 : 1;
+}
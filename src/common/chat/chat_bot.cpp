@@ -6,15 +6,14 @@
 /// \note This is a header file for the chat bot class
 #pragma once
 #include "chat/chat_bot.hpp"
+#include "utils/metrics.hpp"
+#include "utils/trace.hpp"
+#include <filesystem>
 
 chat_bot::chat_bot(unsigned int device_id){
     this->MAX_L = 4096;
     this->device_id = device_id;
     this->total_tokens = 0;
-    this->profiler_list.resize(PROFILER_TYPE_NUM);
-    for (size_t i = 0; i < PROFILER_TYPE_NUM; i++){
-        this->profiler_list[i] = profiler();
-    }
     this->last_prefill_time = {0, "us"};
     this->token_history.reserve(MAX_L);
 }
@@ -63,7 +62,14 @@ void chat_bot::load_model(std::string model_path, json model_info){
         exit(1);
     }
     
+    // Only load_weights is timed, the engine and BO setup above is not part of the weight load
+    auto weights_start_time = time_utils::now();
     this->lm_engine->load_weights(*this->q4nx);
+    double weights_seconds = time_utils::duration_ns(weights_start_time, time_utils::now()).first * 1e-9;
+    std::error_code size_error;
+    uintmax_t weights_bytes = std::filesystem::file_size(this->model_path + "/model.q4nx", size_error);
+    header_print("FLM", "load_weights took " << std::fixed << std::setprecision(2) << weights_seconds << " s for a "
+        << (size_error ? 0 : weights_bytes) / 1e9 << " GB model.q4nx");
     
     //free the q4nx
     this->q4nx.reset();
@@ -76,6 +82,7 @@ void chat_bot::load_model(std::string model_path, json model_info){
     this->lm_engine->clear_context();
     this->last_token = -1;
     this->total_tokens = 0;
+    this->context_has_payload = false;
 
     this->sampler.reset();
 
@@ -130,22 +137,33 @@ bool chat_bot::insert(chat_meta_info& meta_info, std::vector<int>& tokens, bool
         header_print("WARNING", "Max length reached, stopping prefilling...");
         return false;
     }
+    TRACE_SPAN("chat_bot.insert");
     for (int token : tokens){
         this->token_history.push_back(token);
     }
     buffer<bf16> y;
 
     auto prefill_start_time = this->profiler_list[PREFILL_TIME].start();
-    y = this->lm_engine->prefill(tokens, payload);
+    {
+        TRACE_SPAN("causal_lm.prefill");
+        y = this->lm_engine->prefill(tokens, payload);
+    }
     auto prefill_end_time = this->profiler_list[PREFILL_TIME].stop(tokens.size());
     meta_info.prefill_duration = (uint64_t)time_utils::duration_ns(prefill_start_time, prefill_end_time).first;
     meta_info.prompt_tokens = tokens.size();
+    g_metrics.prompt_tokens_total.fetch_add(tokens.size(), std::memory_order_relaxed);
+    if (meta_info.prefill_duration > 0 && !tokens.empty()){
+        g_metrics.prefill_tokens_per_second.observe(tokens.size() * 1e9 / meta_info.prefill_duration);
+    }
     this->total_tokens += tokens.size() + 1;
     if (this->total_tokens >= this->MAX_L){
         header_print("WARNING", "Max length reached, stopping prefilling...");
     }
     this->profiler_list[SAMPLING_TIME].start();
-    this->last_token = this->sampler->sample(y);
+    {
+        TRACE_SPAN("sampler.sample");
+        this->last_token = this->sampler->sample(y);
+    }
     this->profiler_list[SAMPLING_TIME].stop(1);
     if (is_system_prompt){
         this->profiler_list[PREFILL_TIME].reset();
@@ -162,15 +180,18 @@ bool chat_bot::insert(chat_meta_info& meta_info, std::vector<int>& tokens, bool
 /// \param meta_info the meta info
 /// \param length_limit the length limit, -1 means no limit
 /// \param os the output stream
+/// \param is_cancelled the cancellation check, polled before every decoding step
 /// \note The function will generate the tokens
 /// \note The function will check if the tokens are valid
 /// \note The function will check if the max length is reached
 /// \note The function will check if the last token is valid
-std::string chat_bot::generate(chat_meta_info& meta_info, int length_limit, std::ostream& os){
+/// \note The function will stop within one token once is_cancelled returns true
+std::string chat_bot::generate(chat_meta_info& meta_info, int length_limit, std::ostream& os, cancel_check_t is_cancelled){
     assert(this->lm_engine != nullptr);
     assert(this->lm_config != nullptr);
     assert(this->tokenizer != nullptr);
     assert(this->sampler != nullptr);
+    TRACE_SPAN("chat_bot.generate");
     std::vector<int> sampled_tokens;
     if (length_limit > 0){
         sampled_tokens.reserve(length_limit);
@@ -196,36 +217,64 @@ std::string chat_bot::generate(chat_meta_info& meta_info, int length_limit, std:
     this->token_history.push_back(this->last_token);
     auto decoding_start_time = time_utils::now();
     if (this->tokenizer->is_normal_token(last_sampled_token) && last_sampled_token != -1){
-        std::string token_str = this->tokenizer->run_time_decoder(last_sampled_token);
+        std::string_view token_str = this->tokenizer->run_time_decoder_view(last_sampled_token);
         result += token_str;
         os << token_str << std::flush;
 
     }
+    g_metrics.generated_tokens_total.fetch_add(1, std::memory_order_relaxed);
     if (this->tokenizer->is_eos(last_sampled_token)){
+        meta_info.stop_reason = reason;
         return result;
     }
     this->profiler_list[TKOEN_DECODE_TIME].stop(1);
     if (this->total_tokens >= this->MAX_L){
         header_print("WARNING", "Max length reached, stopping generation...");
         reason = MAX_LENGTH_REACHED;
+        meta_info.stop_reason = reason;
         return result;
     }
+    auto last_token_time = time_utils::now();
     while (this->total_tokens < this->MAX_L){
+        if (is_cancelled && is_cancelled()){
+            header_print("FLM", "Generation cancelled after " << meta_info.generated_tokens << " tokens");
+            reason = CANCELLED;
+            break;
+        }
         this->profiler_list[DECODING_TIME].start();
-        buffer<bf16> y = this->lm_engine->forward(last_sampled_token);
+        buffer<bf16> y;
+        {
+            TRACE_SPAN("causal_lm.forward");
+            y = this->lm_engine->forward(last_sampled_token);
+        }
         this->profiler_list[DECODING_TIME].stop(1);
 
         this->profiler_list[SAMPLING_TIME].start();
-        int sampled_token = this->sampler->sample(y);
+        int sampled_token;
+        {
+            TRACE_SPAN("sampler.sample");
+            sampled_token = this->sampler->sample(y);
+        }
         this->profiler_list[SAMPLING_TIME].stop(1);
         this->total_tokens++;
         last_sampled_token = sampled_token;
 
+        auto token_time = time_utils::now();
+        g_metrics.inter_token_seconds.observe(time_utils::duration_ns(last_token_time, token_time).first * 1e-9);
+        last_token_time = token_time;
+
         this->profiler_list[TKOEN_DECODE_TIME].start();
         this->profiler_list[TKOEN_DECODE_TIME].stop(1);
         if (this->tokenizer->is_normal_token(sampled_token)){ // filter out special tokens
-            std::string token_str = this->tokenizer->run_time_decoder(sampled_token);
-            os << token_str << std::flush;
+            std::string_view token_str;
+            {
+                TRACE_SPAN("tokenizer.decode");
+                token_str = this->tokenizer->run_time_decoder_view(sampled_token);
+            }
+            {
+                TRACE_SPAN("stream.write");
+                os << token_str << std::flush;
+            }
             result += token_str;
         }
         this->token_history.push_back(sampled_token);
@@ -234,6 +283,7 @@ std::string chat_bot::generate(chat_meta_info& meta_info, int length_limit, std:
             break;
         }
         meta_info.generated_tokens++;
+        g_metrics.generated_tokens_total.fetch_add(1, std::memory_order_relaxed);
         if ((length_limit > 0) && (meta_info.generated_tokens >= length_limit)){
             reason = MAX_LENGTH_REACHED;
             break;
@@ -242,25 +292,71 @@ std::string chat_bot::generate(chat_meta_info& meta_info, int length_limit, std:
     auto decoding_end_time = time_utils::now();
     meta_info.decoding_duration = (uint64_t)time_utils::duration_ns(decoding_start_time, decoding_end_time).first;
     meta_info.stop_reason = reason;
+    if (meta_info.generated_tokens > 1 && meta_info.decoding_duration > 0){
+        g_metrics.decode_tokens_per_second.observe(meta_info.generated_tokens * 1e9 / meta_info.decoding_duration);
+    }
     if (this->total_tokens >= this->MAX_L){
         header_print("WARNING", "Max length reached, stopping generation...");
     }
     return result;
 }
 
+/// \brief Insert a full prompt, reusing the KV cache of the longest common prefix
+/// \param meta_info the meta info
+/// \param tokens the tokens of the whole conversation
+/// \param payload the payload, e.g. image pixels
+/// \note Only the suffix that diverges from the current context is prefilled
+/// \note Image payloads are not tracked by token ids, so they always force a full reset
+/// \note Sliding-window models always reset, positions that left the window cannot be rewound to
+bool chat_bot::insert_with_prefix_cache(chat_meta_info& meta_info, std::vector<int>& tokens, void* payload){
+    assert(this->lm_engine != nullptr);
+    assert(this->sampler != nullptr);
+    if (tokens.empty()){
+        return false;
+    }
+    // The KV cache may lag the history by the last sampled token if it was never forwarded
+    size_t cached_length = std::min(this->token_history.size(), (size_t)std::max(this->lm_engine->get_current_context_length(), 0));
+    size_t prefix_length = 0;
+    bool sliding_window = this->lm_config->sliding_window > 0;
+    if (payload == nullptr && !this->context_has_payload && !sliding_window){
+        // Keep at least one token to prefill, we need its logits to sample from
+        size_t limit = std::min(cached_length, tokens.size() - 1);
+        while (prefix_length < limit && this->token_history[prefix_length] == tokens[prefix_length]){
+            prefix_length++;
+        }
+    }
+    if (prefix_length == 0){
+        this->clear_context();
+    }
+    else {
+        this->rewind_context(prefix_length);
+        this->sampler->reset_penalties();
+        header_print("FLM", "Prefix cache hit: " << prefix_length << "/" << tokens.size() << " tokens reused");
+    }
+
+    std::vector<int> suffix(tokens.begin() + prefix_length, tokens.end());
+    bool success = this->insert(meta_info, suffix, false, payload);
+    meta_info.prompt_tokens = tokens.size();
+    meta_info.cached_tokens = prefix_length;
+    this->context_has_payload = payload != nullptr;
+    return success;
+}
+
 /// \brief Generate the tokens with prompt
 /// \param meta_info the meta info
 /// \param tokens the tokens
 /// \param length_limit the length limit, -1 means no limit
 /// \param os the output stream
+/// \param payload the payload
+/// \param is_cancelled the cancellation check
 /// \note The function will generate the tokens
-/// \note The function will insert the tokens
+/// \note The function will insert the tokens, reusing the cached prefix
 /// \note The function will check if the tokens are valid
-std::string chat_bot::generate_with_prompt(chat_meta_info& meta_info, std::vector<int>& tokens, int length_limit, std::ostream& os, void* payload){
-    if (!this->insert(meta_info, tokens, false, payload)){
+std::string chat_bot::generate_with_prompt(chat_meta_info& meta_info, std::vector<int>& tokens, int length_limit, std::ostream& os, void* payload, cancel_check_t is_cancelled){
+    if (!this->insert_with_prefix_cache(meta_info, tokens, payload)){
         return "";
     }
-    std::string result = this->generate(meta_info, length_limit, os);
+    std::string result = this->generate(meta_info, length_limit, os, is_cancelled);
     return result;
 }
 
@@ -277,12 +373,28 @@ void chat_bot::clear_context(){
     this->lm_engine->clear_context();
     this->total_tokens = 0;
     this->sampler->reset_penalties();
+    this->context_has_payload = false;
     for (size_t i = 0; i < PROFILER_TYPE_NUM; i++){
         this->profiler_list[i].reset(); 
     }
     this->last_prefill_time = {0, "us"};
 }
 
+/// \brief Rewind the context
+/// \param length the number of tokens to keep
+/// \note The KV cache of the kept tokens is reused, later entries are overwritten by the next prefill
+void chat_bot::rewind_context(size_t length){
+    if (length == 0){
+        this->clear_context();
+        return;
+    }
+    assert(length <= this->token_history.size());
+    this->token_history.resize(length);
+    this->lm_engine->set_context_length(length);
+    this->total_tokens = length;
+    this->last_token = -1;
+}
+
 /// \brief Get the current context length
 /// \note The function will get the current context length
 /// \note The function will return the current context length
@@ -329,6 +441,21 @@ std::string chat_bot::show_profile(){
     ss << "    Average token encoding speed: " << this->profiler_list[TKOEN_ENCODE_TIME].get_average_speed() << " tokens/s" << std::endl;
     ss << "    Average token decoding speed: " << this->profiler_list[TKOEN_DECODE_TIME].get_average_speed() << " tokens/s" << std::endl;
     ss << "    Average overall speed:        " << this->profiler_list[TOTAL_TIME].get_average_speed() << " tokens/s" << std::endl;
+    const profiler_type per_token[] = {DECODING_TIME, SAMPLING_TIME};
+    const char* per_token_name[] = {"Decoding step", "Sampling step"};
+    for (size_t i = 0; i < 2; i++){
+        profiler& p = this->profiler_list[per_token[i]];
+        if (p.get_samples() == 0){
+            continue;
+        }
+        time_utils::time_with_unit p50 = p.get_percentile(50);
+        time_utils::time_with_unit p99 = p.get_percentile(99);
+        time_utils::time_with_unit p999 = p.get_percentile(99.9);
+        ss << "    " << per_token_name[i] << " p50/p99/p99.9: "
+           << p50.first << " " << p50.second << " / "
+           << p99.first << " " << p99.second << " / "
+           << p999.first << " " << p999.second << std::endl;
+    }
 
     return ss.str();
 }
@@ -365,7 +492,13 @@ void chat_bot::verbose(){
     std::cout << "  Total tokens:        " << total_tokens << " (" << std::fixed << std::setprecision(2) << context_percentage << "%)" << std::endl;
     std::cout << "  TTFT:                " << ttft_time.first << " " << ttft_time.second << std::endl;
     std::cout << "  Prefill speed:       " << std::fixed << std::setprecision(2) << prefill_speed  << " tokens/s" << std::endl;
-    std::cout << "  Decoding speed:      " << std::fixed << std::setprecision(2) << decoding_speed << " tokens/s" << std::endl << std::endl;
+    std::cout << "  Decoding speed:      " << std::fixed << std::setprecision(2) << decoding_speed << " tokens/s" << std::endl;
+    if (this->profiler_list[DECODING_TIME].get_samples() > 0){
+        time_utils::time_with_unit p50 = this->profiler_list[DECODING_TIME].get_percentile(50);
+        time_utils::time_with_unit p99 = this->profiler_list[DECODING_TIME].get_percentile(99);
+        std::cout << "  Decoding step:       p50 " << p50.first << " " << p50.second << ", p99 " << p99.first << " " << p99.second << std::endl;
+    }
+    std::cout << std::endl;
 
 
 }
@@ -380,6 +513,7 @@ void chat_bot::set_topk(int topk){
         return;
     }
     this->sampler->top_k = topk;
+    this->sampler->update_mode();
 }
 
 /// \brief Set the top-p
@@ -392,6 +526,7 @@ void chat_bot::set_topp(float topp){
         return;
     }
     this->sampler->top_p = topp;
+    this->sampler->update_mode();
 }
 
 /// \brief Set the temperature
@@ -404,6 +539,7 @@ void chat_bot::set_temperature(float temperature){
         return;
     }
     this->sampler->temperature = temperature;
+    this->sampler->update_mode();
 }
 
 /// \brief Set the repetition penalty
@@ -442,6 +578,54 @@ void chat_bot::set_frequency_penalty_window(int frequency_penalty_window){
     this->sampler->freq_penalty_window = frequency_penalty_window;
 }
 
+/// \brief Set the min-p
+/// \param min_p the min-p, 0 disables it
+/// \note The function will check if the min-p is valid
+void chat_bot::set_min_p(float min_p){
+    if (min_p < 0.0f || min_p > 1.0f){
+        header_print("WARNING", "Min-p must be between 0.0 and 1.0");
+        return;
+    }
+    this->sampler->min_p = min_p;
+    this->sampler->update_mode();
+}
+
+/// \brief Set the typical-p
+/// \param typical_p the typical-p, 1 disables it
+/// \note The function will check if the typical-p is valid
+void chat_bot::set_typical_p(float typical_p){
+    if (typical_p <= 0.0f || typical_p > 1.0f){
+        header_print("WARNING", "Typical-p must be between 0.0 and 1.0");
+        return;
+    }
+    this->sampler->typical_p = typical_p;
+    this->sampler->update_mode();
+}
+
+/// \brief Set mirostat
+/// \param mirostat the version, 0 disables it
+/// \param tau the target surprise
+/// \param eta the learning rate
+/// \note The function will reset the mirostat state
+void chat_bot::set_mirostat(int mirostat, float tau, float eta){
+    if (mirostat < 0 || mirostat > 2){
+        header_print("WARNING", "Mirostat must be 0, 1 or 2");
+        return;
+    }
+    this->sampler->mirostat = mirostat;
+    this->sampler->mirostat_tau = tau;
+    this->sampler->mirostat_eta = eta;
+    this->sampler->mirostat_mu = 2.0f * tau;
+    this->sampler->update_mode();
+}
+
+/// \brief Set the sampling seed
+/// \param seed the seed, negative for a random seed
+/// \note The function will reseed the sampler PRNG
+void chat_bot::set_seed(int64_t seed){
+    this->sampler->set_seed(seed);
+}
+
 
 /// \brief Tokenize the text
 /// \param text the text
@@ -465,11 +649,13 @@ std::vector<int> chat_bot::tokenize(std::string& text, bool apply_chat_template,
             }
             messages.push_back(content);
         }
+        TRACE_SPAN("chat_template.render");
         new_text = this->tokenizer->apply_chat_template(messages, add_generation_prompt, this->enable_think);
     }
     else{
         new_text = text;
     }
+    TRACE_SPAN("tokenizer.encode");
     std::vector<int> tokens = this->tokenizer->encode(new_text);
     this->profiler_list[TKOEN_ENCODE_TIME].stop(tokens.size());
     return tokens;
@@ -480,8 +666,13 @@ std::vector<int> chat_bot::tokenize(std::string& text, bool apply_chat_template,
 /// \param add_generation_prompt the add generation prompt
 /// \return the chat template
 std::vector<int> chat_bot::tokenize(nlohmann::ordered_json& messages, bool add_generation_prompt){
-    std::string text = this->tokenizer->apply_chat_template(messages, add_generation_prompt, this->enable_think);
-    return this->tokenizer->encode(text);
+    std::string text;
+    {
+        TRACE_SPAN("chat_template.render");
+        text = this->tokenizer->apply_chat_template(messages, add_generation_prompt, this->enable_think);
+    }
+    TRACE_SPAN("tokenizer.encode");
+    return this->tokenizer->encode_prompt(text);
 }
 
 /// \brief Decode the tokens
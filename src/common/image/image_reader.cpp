@@ -249,25 +249,22 @@ bytes load_image(const std::string& filename) {
     }
 }
 
-bytes load_image_base64(const std::string& base64_string) {
+bytes load_image_base64(std::string_view base64_string) {
     initialize_ffmpeg();
     
     const int target_width = 896;
     const int target_height = 896;
     
     try {
-        // Decode base64 to binary data
-        std::string decoder_bytes = base64::from_base64(base64_string);
+        // Decode base64 straight into the packet data, the input may be a view into the request body
+        std::vector<uint8_t> file_data = base64::decode_into<std::vector<uint8_t>>(base64_string);
         
         // Check for valid image formats
-        if (decoder_bytes.size() < 8) {
+        if (file_data.size() < 8) {
             std::cerr << "Error: Invalid image data (too small)" << std::endl;
             return bytes();
         }
         
-        // Convert string to vector<uint8_t> for processing
-        std::vector<uint8_t> file_data(decoder_bytes.begin(), decoder_bytes.end());
-        
         // Create memory context for decoding
         AVCodecContext* codecContext = nullptr;
         AVFrame* frame = nullptr;
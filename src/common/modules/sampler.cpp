@@ -9,10 +9,231 @@
 #include "modules/sampler.hpp"
 
 #include <deque>
-#include <cstdlib>    // for std::rand, std::srand, RAND_MAX
-#include <ctime>      // for std::time
-#include <algorithm>  // for std::sort
-#include <cmath>      // for std::exp
+#include <random>     // for std::random_device
+#include <algorithm>  // for std::push_heap, std::pop_heap, std::sort_heap
+#include <bit>        // for std::countr_zero
+#include <cmath>      // for std::exp, std::log, std::pow
+#include <limits>
+
+#if defined(__AVX2__) || USEAVX2
+#define SAMPLER_SIMD_AVX2 1
+#define SAMPLER_SIMD_SSE2 0
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define SAMPLER_SIMD_AVX2 0
+#define SAMPLER_SIMD_SSE2 1
+#else
+#define SAMPLER_SIMD_AVX2 0
+#define SAMPLER_SIMD_SSE2 0
+#endif
+
+namespace {
+
+/// \brief Min-heap order, the smallest kept logit is at the front
+inline bool heap_greater(const logits_t& a, const logits_t& b) {
+    return a.first > b.first;
+}
+
+/// \brief Offer a candidate to the top-k heap
+/// \param heap the heap, at most k entries
+/// \param k the k
+/// \param value the logit
+/// \param index the token
+/// \param threshold the smallest kept logit once the heap is full, candidates must beat it
+inline void heap_offer(logits_list_t& heap, int k, float value, int index, float& threshold) {
+    if ((int)heap.size() < k) {
+        heap.emplace_back(value, index);
+        std::push_heap(heap.begin(), heap.end(), heap_greater);
+        if ((int)heap.size() == k) {
+            threshold = heap.front().first;
+        }
+        return;
+    }
+    if (value <= threshold) {
+        return;
+    }
+    std::pop_heap(heap.begin(), heap.end(), heap_greater);
+    heap.back() = std::make_pair(value, index);
+    std::push_heap(heap.begin(), heap.end(), heap_greater);
+    threshold = heap.front().first;
+}
+
+/// \brief Select the k largest logits, sorted in descending order
+/// \param x the bf16 logits of the model
+/// \param n the number of logits
+/// \param k the k
+/// \param logits the penalized fp32 logits, only read for the active tokens
+/// \param active_tokens the tokens with a penalty
+/// \param is_active the membership flags of active_tokens
+/// \param top_k the output
+/// \note The active tokens are offered first with their penalized logits, the scan then
+///       widens bf16 in registers and skips them, so the vocabulary is never stored as fp32.
+/// \note Blocks with no logit above the current k-th largest are skipped with one compare,
+///       after the first few thousand logits almost every block is skipped
+void select_top_k(const bf16* x, int n, int k, const std::vector<float>& logits,
+                  const std::vector<int>& active_tokens, const std::vector<u8>& is_active,
+                  logits_list_t& top_k) {
+    top_k.clear();
+    k = std::max(1, std::min(k, n));
+    float threshold = -std::numeric_limits<float>::infinity();
+    for (int token_id : active_tokens) {
+        heap_offer(top_k, k, logits[token_id], token_id, threshold);
+    }
+    int i = 0;
+#if SAMPLER_SIMD_AVX2
+    for (; i <= n - 16; i += 16) {
+        __m256 v_t = _mm256_set1_ps(threshold);
+        __m256 lo = bf16o_fp32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+        __m256 hi = bf16o_fp32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i + 8)));
+        unsigned int mask = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(lo, v_t, _CMP_GT_OQ))
+                          | ((unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(hi, v_t, _CMP_GT_OQ)) << 8);
+        while (mask != 0) {
+            int lane = std::countr_zero(mask);
+            mask &= mask - 1;
+            if (!is_active[i + lane]) {
+                heap_offer(top_k, k, x[i + lane].as_float(), i + lane, threshold);
+            }
+        }
+    }
+#elif SAMPLER_SIMD_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i <= n - 8; i += 8) {
+        // bf16 is the upper half of an fp32, interleave with zeros to widen
+        __m128 v_t = _mm_set1_ps(threshold);
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        __m128 lo = _mm_castsi128_ps(_mm_unpacklo_epi16(zero, v));
+        __m128 hi = _mm_castsi128_ps(_mm_unpackhi_epi16(zero, v));
+        unsigned int mask = (unsigned int)(_mm_movemask_ps(_mm_cmpgt_ps(lo, v_t))
+                          | (_mm_movemask_ps(_mm_cmpgt_ps(hi, v_t)) << 4));
+        while (mask != 0) {
+            int lane = std::countr_zero(mask);
+            mask &= mask - 1;
+            if (!is_active[i + lane]) {
+                heap_offer(top_k, k, x[i + lane].as_float(), i + lane, threshold);
+            }
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        float value = x[i].as_float();
+        if (value > threshold && !is_active[i]) {
+            heap_offer(top_k, k, value, i, threshold);
+        }
+    }
+    // sort_heap with a greater-than order leaves the largest logit first
+    std::sort_heap(top_k.begin(), top_k.end(), heap_greater);
+}
+
+/// \brief Candidates offered to mirostat, its estimate needs more than the usual top-k
+const int MIROSTAT_CANDIDATES = 100;
+
+/// \brief Sum of the candidate weights
+/// \param candidates the weights
+/// \param count the number of candidates
+float weight_sum(const logits_list_t& candidates, int count) {
+    float sum = 0.0f;
+    for (int i = 0; i < count; i++) {
+        sum += candidates[i].first;
+    }
+    return sum;
+}
+
+/// \brief Draw one candidate
+/// \param candidates the weights, not normalized
+/// \param count the number of candidates
+/// \param sum the sum of the weights
+/// \param u the uniform draw in [0, 1)
+/// \return the position of the drawn candidate
+/// \note Scales the uniform draw instead of normalizing the weights
+int draw_candidate(const logits_list_t& candidates, int count, float sum, float u) {
+    float target = u * sum;
+    float cdf = 0.0f;
+    for (int i = 0; i < count; i++) {
+        cdf += candidates[i].first;
+        if (target < cdf) {
+            return i;
+        }
+    }
+    return count - 1;
+}
+
+/// \brief Keep the smallest prefix holding top_p of the mass
+/// \param candidates the weights, sorted in descending order
+/// \param count the number of candidates
+/// \param sum the sum of the weights
+/// \param top_p the top p
+/// \return the number of kept candidates
+int truncate_top_p(const logits_list_t& candidates, int count, float sum, float top_p) {
+    float threshold = top_p * sum;
+    float running = 0.0f;
+    for (int i = 0; i < count; i++) {
+        running += candidates[i].first;
+        if (running > threshold) {
+            return i + 1;
+        }
+    }
+    return count;
+}
+
+/// \brief Drop the candidates below min_p times the most likely one
+/// \param candidates the weights, kept in order
+/// \param count the number of candidates
+/// \param min_p the min p
+/// \return the number of kept candidates
+int truncate_min_p(logits_list_t& candidates, int count, float min_p) {
+    float max_weight = 0.0f;
+    for (int i = 0; i < count; i++) {
+        max_weight = std::max(max_weight, candidates[i].first);
+    }
+    float threshold = min_p * max_weight;
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (candidates[i].first >= threshold) {
+            candidates[kept++] = candidates[i];
+        }
+    }
+    return kept;
+}
+
+/// \brief Keep the candidates whose surprise is closest to the entropy, up to typical_p of the mass
+/// \param candidates the weights, reordered by distance to the entropy
+/// \param count the number of candidates
+/// \param typical_p the typical p
+/// \param scratch reused storage
+/// \return the number of kept candidates
+int truncate_typical_p(logits_list_t& candidates, int count, float typical_p, logits_list_t& scratch) {
+    float inv_sum = 1.0f / weight_sum(candidates, count);
+    float entropy = 0.0f;
+    for (int i = 0; i < count; i++) {
+        float prob = candidates[i].first * inv_sum;
+        if (prob > 0.0f) {
+            entropy -= prob * std::log(prob);
+        }
+    }
+    // Sort by |surprise - entropy|, the position is kept as the payload
+    scratch.resize(count);
+    for (int i = 0; i < count; i++) {
+        float prob = candidates[i].first * inv_sum;
+        float surprise = prob > 0.0f ? -std::log(prob) : std::numeric_limits<float>::infinity();
+        scratch[i] = std::make_pair(std::abs(surprise - entropy), i);
+    }
+    std::sort(scratch.begin(), scratch.end());
+    float running = 0.0f;
+    int kept = count;
+    for (int i = 0; i < count; i++) {
+        running += candidates[scratch[i].second].first * inv_sum;
+        if (running >= typical_p) {
+            kept = i + 1;
+            break;
+        }
+    }
+    for (int i = 0; i < kept; i++) {
+        scratch[i] = candidates[scratch[i].second];
+    }
+    std::copy(scratch.begin(), scratch.begin() + kept, candidates.begin());
+    return kept;
+}
+
+} // namespace
 
 /// \brief Constructor
 /// \param in_features the input features
@@ -22,7 +243,8 @@ Sampler::Sampler(int in_features, sampler_config& config) {
     this->logits.resize(in_features);
     this->counters.resize(in_features, 0);
     this->token_positions.resize(in_features, -1);
-    this->top_k_logits.resize(config.top_k);
+    this->is_active.resize(in_features, 0);
+    this->top_k_logits.reserve(config.top_k);
 
     this->temperature           = config.temperature;
     this->top_k                 = config.top_k;
@@ -35,6 +257,26 @@ Sampler::Sampler(int in_features, sampler_config& config) {
     this->freq_penalty_window   = config.freq_penalty_window;
 
     this->token_history.clear();
+    this->min_p                 = config.min_p;
+    this->typical_p             = config.typical_p;
+    this->mirostat              = config.mirostat;
+    this->mirostat_tau          = config.mirostat_tau;
+    this->mirostat_eta          = config.mirostat_eta;
+    this->mirostat_mu           = 2.0f * config.mirostat_tau;
+
+    this->set_seed(config.seed);
+    this->update_mode();
+}
+
+/// \brief Seed the PRNG
+/// \param seed the seed, negative for a random seed
+void Sampler::set_seed(int64_t seed) {
+    if (seed < 0) {
+        std::random_device device;
+        this->rng.seed(((uint64_t)device() << 32) ^ device());
+    } else {
+        this->rng.seed((uint64_t)seed);
+    }
 }
 
 /// \brief Reset the penalties
@@ -42,205 +284,287 @@ Sampler::Sampler(int in_features, sampler_config& config) {
 /// \note The function will reset the token positions
 /// \note The function will reset the token history
 /// \note The function will reset the total tokens
-/// \note The function will reset the token positions
+/// \note Only the tokens in the active set can have state, so only they are cleared
 void Sampler::reset_penalties() {
-    for (int i = 0; i < in_features; i++) {
-        this->counters[i]            = 0;
-        this->token_positions[i]     = -1;
+    for (int token_id : this->active_tokens) {
+        this->counters[token_id]        = 0;
+        this->token_positions[token_id] = -1;
+        this->is_active[token_id]       = 0;
     }
+    this->active_tokens.clear();
     this->total_tokens = 0;
     this->token_history.clear();
+    this->mirostat_mu = 2.0f * this->mirostat_tau;
 }
 
-/// \brief Sample the token
-/// \param x the input buffer
-/// \return the sampled token
-int Sampler::sample(buffer<bf16>& x) {
-    // Re‐seed the PRNG each call:
-    std::srand(static_cast<unsigned>(std::time(nullptr)));
-
-    //
-    // 1) COPY FROM `x` → `this->logits[]`
-    //
-    #if USEAVX2
-    const int simd_width = 8;
-    int i = 0;
-    for (; i <= in_features - simd_width; i += simd_width) {
-        __m128i bf16_vals_x = _mm_loadu_si128(
-            (__m128i*)&x[i]
-        );
-        __m256 fp32_vals_x = bf16o_fp32(bf16_vals_x);
-        _mm256_storeu_ps(&this->logits[i], fp32_vals_x);
-    }
-    for (; i < in_features; i++) {
-        this->logits[i] = x[i].as_float();
-    }
-    #else
-    for (int i = 0; i < in_features; i++) {
-        this->logits[i] = x[i].as_float();
-    }
-    #endif
+/// \brief Apply the repetition and frequency penalties to the active tokens
+/// \param x the bf16 logits, the penalized logits of the active tokens are written to this->logits
+/// \note Same arithmetic as a full-vocabulary pass, tokens outside the set have no penalty to apply
+void Sampler::apply_penalties(const bf16* x) {
+    bool use_rep  = this->rep_penalty_window > 0 && this->rep_penalty != 1.0f;
+    bool use_freq = this->freq_penalty_window > 0 && this->freq_penalty != 1.0f;
+    size_t n = 0;
+    while (n < this->active_tokens.size()) {
+        int token_id = this->active_tokens[n];
+        size_t distance = this->total_tokens - this->token_positions[token_id];
+        bool in_rep_window = distance < this->rep_penalty_window;
+        if (!in_rep_window && this->counters[token_id] == 0) {
+            // Out of both windows, it cannot be penalized again until it is sampled again
+            this->is_active[token_id] = 0;
+            this->active_tokens[n] = this->active_tokens.back();
+            this->active_tokens.pop_back();
+            continue;
+        }
+        this->logits[token_id] = x[token_id].as_float();
 
-    //
-    // 2) APPLY REPETITION + FREQUENCY PENALTIES
-    //
-    for (int token_id = 0; token_id < in_features; token_id++) {
         // --- (A) Repetition Penalty (sliding window = rep_penalty_window) ---
-        int last_pos = this->token_positions[token_id]; // –1 if never seen
-        if (last_pos >= 0 && this->rep_penalty_window > 0 && this->rep_penalty != 1.0f) {
-            size_t distance = this->total_tokens - last_pos;
-            if (distance < this->rep_penalty_window) {
-                // Apply penalty based on sign: if logit < 0 then multiply, else divide
-                if (this->logits[token_id] < 0.0f) {
-                    this->logits[token_id] = this->logits[token_id] * this->rep_penalty;
-                } else {
-                    this->logits[token_id] = this->logits[token_id] / this->rep_penalty;
-                }
+        if (use_rep && in_rep_window) {
+            // Apply penalty based on sign: if logit < 0 then multiply, else divide
+            if (this->logits[token_id] < 0.0f) {
+                this->logits[token_id] = this->logits[token_id] * this->rep_penalty;
+            } else {
+                this->logits[token_id] = this->logits[token_id] / this->rep_penalty;
             }
         }
 
         // --- (B) Frequency Penalty (sliding window = freq_penalty_window) ---
-        if (this->freq_penalty_window > 0 && this->freq_penalty != 1.0f) {
+        if (use_freq) {
             float normalized_freq = (float)this->counters[token_id] /
                                     (float)this->freq_penalty_window;
             // Apply frequency penalty: subtract penalty * frequency
             this->logits[token_id] =
                 this->logits[token_id] - (this->freq_penalty - 1.0f) * normalized_freq;
         }
+        n++;
     }
+}
 
-    //
-    // 3) TEMPERATURE NORMALIZATION
-    //    Subtract max_logit and divide by temperature
-    //
-    float max_logit = -1e9f;
-    for (int i = 0; i < in_features; i++) {
-        if (this->logits[i] > max_logit) {
-            max_logit = this->logits[i];
-        }
-    }
+/// \brief Record a sampled token in the penalty state
+/// \param token the token
+void Sampler::update_penalties(int token) {
+    if (this->freq_penalty_window > 0) {
+        // Push new token and update its counter
+        this->token_history.push_back(token);
+        this->counters[token]++;
 
-    #if USEAVX2
-    {
-        int i = 0;
-        __m256 v_temp = _mm256_set1_ps(this->temperature);
-        __m256 v_max  = _mm256_set1_ps(max_logit);
-        for (; i <= in_features - simd_width; i += simd_width) {
-            __m256 v_logits = _mm256_loadu_ps(&this->logits[i]);
-            __m256 v_sub    = _mm256_sub_ps(v_logits, v_max);
-            __m256 v_div    = _mm256_div_ps(v_sub, v_temp);
-            _mm256_storeu_ps(&this->logits[i], v_div);
-        }
-        for (; i < in_features; i++) {
-            this->logits[i] = (this->logits[i] - max_logit) / this->temperature;
+        // If buffer exceeds window, pop oldest and decrement its counter
+        while (this->token_history.size() > this->freq_penalty_window) {
+            int oldest = this->token_history.front();
+            this->token_history.pop_front();
+            this->counters[oldest]--;
         }
     }
-    #else
-    for (int i = 0; i < in_features; i++) {
-        this->logits[i] = (this->logits[i] - max_logit) / this->temperature;
+
+    // Update last‐seen position for repetition penalty
+    this->token_positions[token] = this->total_tokens;
+    if (!this->is_active[token]) {
+        this->is_active[token] = 1;
+        this->active_tokens.push_back(token);
     }
-    #endif
 
-    //
-    // 4) TOP‐K + TOP‐P FILTERING
-    //
-    // 4.1 Initialize top_k buffer to (−∞, 0)
-    float min_logit = -1e9f;
-    int   min_index = 0;
-    this->top_k_logits.clear();
-    this->top_k_logits.resize(this->top_k, std::make_pair(min_logit, min_index));
-
-    // 4.2 Collect top_k highest logits
-    for (int i = 0; i < in_features; i++) {
-        if (this->logits[i] > min_logit) {
-            this->top_k_logits[min_index] = std::make_pair(this->logits[i], i);
-            // Re‐find the new minimum among top_k entries
-            float new_min_val = this->top_k_logits[0].first;
-            int   new_min_idx = 0;
-            for (int j = 1; j < this->top_k; j++) {
-                if (this->top_k_logits[j].first < new_min_val) {
-                    new_min_val = this->top_k_logits[j].first;
-                    new_min_idx = j;
-                }
-            }
-            min_logit = new_min_val;
-            min_index = new_min_idx;
+    // Advance global token count
+    this->total_tokens++;
+}
+
+/// \brief Pick the sampling variant for the current parameters
+/// \note Call it after changing temperature, top_k or top_p
+void Sampler::update_mode() {
+    this->chain.clear();
+    if (this->mirostat != 0) {
+        this->chain.push_back(SAMPLER_STAGE_MIROSTAT);
+    } else {
+        if (this->top_p < 1.0f) {
+            this->chain.push_back(SAMPLER_STAGE_TOP_P);
+        }
+        if (this->min_p > 0.0f) {
+            this->chain.push_back(SAMPLER_STAGE_MIN_P);
+        }
+        if (this->typical_p < 1.0f) {
+            this->chain.push_back(SAMPLER_STAGE_TYPICAL_P);
         }
     }
 
-    // 4.3 Sort top_k entries in descending order
-    std::sort(
-        this->top_k_logits.begin(),
-        this->top_k_logits.end(),
-        [](const logits_t& a, const logits_t& b) {
-            return a.first > b.first;
-        }
-    );
+    if (this->temperature <= 0.0f || (this->top_k <= 1 && this->mirostat == 0)) {
+        this->mode = SAMPLER_MODE_GREEDY;
+    } else if (this->chain.empty()) {
+        this->mode = SAMPLER_MODE_TOP_K;
+    } else if (this->chain.size() == 1 && this->chain[0] == SAMPLER_STAGE_TOP_P) {
+        this->mode = SAMPLER_MODE_TOP_K_TOP_P;
+    } else {
+        this->mode = SAMPLER_MODE_CHAIN;
+    }
+}
 
-    // 4.4 Convert logits→exp(logit) and sum
-    float sum_exp = 0.0f;
-    for (int i = 0; i < this->top_k; i++) {
-        this->top_k_logits[i].first = std::exp(this->top_k_logits[i].first);
-        sum_exp += this->top_k_logits[i].first;
+/// \brief Replace the stages of the chain
+/// \param stages the stages, in order
+void Sampler::set_chain(const std::vector<sampler_stage_t>& stages) {
+    this->chain = stages;
+    if (this->mode != SAMPLER_MODE_GREEDY) {
+        this->mode = SAMPLER_MODE_CHAIN;
     }
-    float inv_sum_exp = 1.0f / sum_exp;
+}
 
-    // 4.5 Find cutoff index for top_p
-    float running_prob = 0.0f;
-    int   top_p_index  = this->top_k - 1;
-    for (int i = 0; i < this->top_k; i++) {
-        running_prob += this->top_k_logits[i].first * inv_sum_exp;
-        if (running_prob > this->top_p) {
-            top_p_index = i;
+/// \brief Run the chain on the weighted candidates and draw one
+/// \param count the number of candidates in top_k_logits, sorted in descending order
+/// \return the sampled token
+/// \note Every stage is O(k), typical-p sorts the k candidates
+int Sampler::sample_chain(int count) {
+    logits_list_t& candidates = this->top_k_logits;
+    for (sampler_stage_t stage : this->chain) {
+        if (count <= 1) {
             break;
         }
+        switch (stage) {
+            case SAMPLER_STAGE_TOP_P:
+                count = truncate_top_p(candidates, count, weight_sum(candidates, count), this->top_p);
+                break;
+            case SAMPLER_STAGE_MIN_P:
+                count = truncate_min_p(candidates, count, this->min_p);
+                break;
+            case SAMPLER_STAGE_TYPICAL_P:
+                count = truncate_typical_p(candidates, count, this->typical_p, this->chain_scratch);
+                break;
+            case SAMPLER_STAGE_MIROSTAT:
+                return this->sample_mirostat(count);
+        }
     }
+    return candidates[draw_candidate(candidates, count, weight_sum(candidates, count), this->rng.next_float())].second;
+}
 
-    // 4.6 Renormalize only up to top_p_index
-    float sum_exp_p = 0.0f;
-    for (int i = 0; i <= top_p_index; i++) {
-        sum_exp_p += this->top_k_logits[i].first;
+/// \brief Mirostat, truncate the candidates to hold the observed surprise at mirostat_tau
+/// \param count the number of candidates in top_k_logits, sorted in descending order
+/// \return the sampled token
+/// \note Version 1 estimates the Zipf exponent from the candidates to pick k, version 2 drops the
+///       candidates whose surprise exceeds mu. Probabilities are taken over the candidates, not the vocabulary.
+int Sampler::sample_mirostat(int count) {
+    logits_list_t& candidates = this->top_k_logits;
+    float inv_sum = 1.0f / weight_sum(candidates, count);
+    int kept = count;
+    if (this->mirostat == 1) {
+        // Least-squares fit of the Zipf exponent over the candidates
+        float sum_ti_bi = 0.0f;
+        float sum_ti_sq = 0.0f;
+        for (int i = 0; i < count - 1; i++) {
+            if (candidates[i + 1].first <= 0.0f) {
+                break;
+            }
+            float t_i = std::log((float)(i + 2) / (float)(i + 1));
+            float b_i = std::log(candidates[i].first / candidates[i + 1].first);
+            sum_ti_bi += t_i * b_i;
+            sum_ti_sq += t_i * t_i;
+        }
+        float s_hat = sum_ti_sq > 0.0f ? sum_ti_bi / sum_ti_sq : 0.0f;
+        float epsilon_hat = s_hat - 1.0f;
+        if (std::abs(epsilon_hat) > 1e-6f) {
+            float k = std::pow((epsilon_hat * std::pow(2.0f, this->mirostat_mu)) /
+                               (1.0f - std::pow((float)this->in_features, -epsilon_hat)), 1.0f / s_hat);
+            kept = std::isfinite(k) ? (int)std::min(std::max(k, 1.0f), (float)count) : count;
+        }
+    } else {
+        kept = 1;
+        for (int i = 1; i < count; i++) {
+            if (-std::log2(candidates[i].first * inv_sum) > this->mirostat_mu) {
+                break;
+            }
+            kept = i + 1;
+        }
     }
-    float inv_sum_exp_p = 1.0f / sum_exp_p;
-    for (int i = 0; i <= top_p_index; i++) {
-        this->top_k_logits[i].first *= inv_sum_exp_p;
+
+    float kept_sum = weight_sum(candidates, kept);
+    int position = draw_candidate(candidates, kept, kept_sum, this->rng.next_float());
+    float observed_surprise = -std::log2(candidates[position].first / kept_sum);
+    this->mirostat_mu -= this->mirostat_eta * (observed_surprise - this->mirostat_tau);
+    return candidates[position].second;
+}
+
+/// \brief Sample the token
+/// \param x the input buffer
+/// \return the sampled token
+int Sampler::sample(buffer<bf16>& x) {
+    switch (this->mode) {
+        case SAMPLER_MODE_GREEDY:
+            return this->sample_mode<SAMPLER_MODE_GREEDY>(x);
+        case SAMPLER_MODE_TOP_K:
+            return this->sample_mode<SAMPLER_MODE_TOP_K>(x);
+        case SAMPLER_MODE_TOP_K_TOP_P:
+            return this->sample_mode<SAMPLER_MODE_TOP_K_TOP_P>(x);
+        default:
+            return this->sample_mode<SAMPLER_MODE_CHAIN>(x);
     }
+}
 
+/// \brief Sample the token with one variant
+/// \param x the input buffer
+/// \return the sampled token
+/// \note Penalties touch only the active tokens, one streaming pass over the bf16 logits selects the top-k,
+///       everything after works on k entries. Greedy stops at the argmax, top-k skips the top-p cutoff.
+template<sampler_mode_t MODE>
+int Sampler::sample_mode(buffer<bf16>& x) {
     //
-    // 5) SAMPLE ONE TOKEN FROM THE FINAL DISTRIBUTION
+    // 1) APPLY REPETITION + FREQUENCY PENALTIES (sparse)
     //
-    float u   = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX);
-    float cdf = 0.0f;
-    int   sampled_index = this->top_k_logits[top_p_index].second;
-    for (int i = 0; i <= top_p_index; i++) {
-        cdf += this->top_k_logits[i].first;
-        if (u < cdf) {
-            sampled_index = this->top_k_logits[i].second;
-            break;
-        }
-    }
+    this->apply_penalties(x.data());
 
     //
-    // 6) UPDATE RING BUFFER (token_history), COUNTERS, POSITIONS, total_tokens
+    // 2) TOP‐K SELECTION
+    //    The first entry is the maximum, temperature scaling only needs the k survivors
     //
-    if (this->freq_penalty_window > 0) {
-        // Push new token and update its counter
-        this->token_history.push_back(sampled_index);
-        this->counters[sampled_index]++;
-
-        // If buffer exceeds window, pop oldest and decrement its counter
-        if (this->token_history.size() > this->freq_penalty_window) {
-            int oldest = this->token_history.front();
-            this->token_history.pop_front();
-            this->counters[oldest]--;
+    int k_limit = this->top_k;
+    if constexpr (MODE == SAMPLER_MODE_GREEDY) {
+        k_limit = 1;
+    } else if constexpr (MODE == SAMPLER_MODE_CHAIN) {
+        if (this->mirostat != 0) {
+            k_limit = std::max(k_limit, MIROSTAT_CANDIDATES);
         }
     }
+    select_top_k(x.data(), this->in_features, k_limit, this->logits,
+                 this->active_tokens, this->is_active, this->top_k_logits);
+    int k = (int)this->top_k_logits.size();
+    int sampled_index = this->top_k_logits[0].second;
 
-    // Update last‐seen position for repetition penalty
-    this->token_positions[sampled_index] = this->total_tokens;
+    if constexpr (MODE != SAMPLER_MODE_GREEDY) {
+        if (k > 1) {
+            //
+            // 3) TEMPERATURE
+            //    Convert logits→exp((logit - max) / temperature) and sum
+            //
+            float max_logit = this->top_k_logits[0].first;
+            float inv_temperature = 1.0f / this->temperature;
+            float sum_exp = 0.0f;
+            for (int i = 0; i < k; i++) {
+                this->top_k_logits[i].first = std::exp((this->top_k_logits[i].first - max_logit) * inv_temperature);
+                sum_exp += this->top_k_logits[i].first;
+            }
 
-    // Advance global token count
-    this->total_tokens++;
+            if constexpr (MODE == SAMPLER_MODE_CHAIN) {
+                //
+                // 4) CHAIN (top-p, min-p, typical-p, mirostat) AND SAMPLE
+                //
+                sampled_index = this->sample_chain(k);
+            } else {
+                //
+                // 4) TOP‐P FILTERING
+                //    Find the cutoff and the mass of the kept entries
+                //
+                int count = k;
+                if constexpr (MODE == SAMPLER_MODE_TOP_K_TOP_P) {
+                    count = truncate_top_p(this->top_k_logits, k, sum_exp, this->top_p);
+                    sum_exp = weight_sum(this->top_k_logits, count);
+                }
+
+                //
+                // 5) SAMPLE ONE TOKEN FROM THE FINAL DISTRIBUTION
+                //
+                int position = draw_candidate(this->top_k_logits, count, sum_exp, this->rng.next_float());
+                sampled_index = this->top_k_logits[position].second;
+            }
+        }
+    }
+
+    //
+    // 6) UPDATE RING BUFFER (token_history), COUNTERS, POSITIONS, total_tokens
+    //
+    this->update_penalties(sampled_index);
 
     return sampled_index;
-}
\ No newline at end of file
+}
@@ -0,0 +1,107 @@
+/// \file mapped_safe_tensors.cpp
+/// \brief MappedSafeTensors class
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Layout: 8-byte little-endian header length, JSON header, then the tensor data.
+#include "tensor_utils/mapped_safe_tensors.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+/// \brief Constructor
+/// \param file_path the safe-tensors file
+MappedSafeTensors::MappedSafeTensors(const std::string& file_path) {
+    this->file_path = file_path;
+    if (!this->file.open(file_path)) {
+        throw std::runtime_error("Failed to map file: " + file_path);
+    }
+    this->_parse_header();
+}
+
+/// \brief Parse the header and build the tensor views
+void MappedSafeTensors::_parse_header() {
+    const uint8_t* base = this->file.data();
+    size_t file_size = this->file.size();
+    if (file_size < 8) {
+        throw std::runtime_error("Invalid safetensors file: " + this->file_path);
+    }
+    uint64_t header_size = 0;
+    for (int i = 7; i >= 0; i--) {
+        header_size = (header_size << 8) | base[i];
+    }
+    if (header_size > file_size - 8) {
+        throw std::runtime_error("Invalid safetensors header size: " + this->file_path);
+    }
+    // The header is touched once, the data section is read ahead while it is parsed
+    this->file.advise(MAPPED_ADVICE_WILLNEED, 0, 8 + (size_t)header_size);
+    nlohmann::json header = nlohmann::json::parse(base + 8, base + 8 + header_size);
+    const uint8_t* data_start = base + 8 + header_size;
+    size_t data_size = file_size - 8 - (size_t)header_size;
+
+    for (auto& [name, entry] : header.items()) {
+        if (name == "__metadata__") {
+            this->metadata = entry;
+            continue;
+        }
+        tensor_view tensor;
+        tensor.meta.name = name;
+        tensor.meta.dtype = entry.at("dtype").get<std::string>();
+        tensor.meta.shape = entry.at("shape").get<std::vector<size_t>>();
+        tensor.meta.offsets = entry.at("data_offsets").get<std::vector<size_t>>();
+        if (tensor.meta.offsets.size() != 2 || tensor.meta.offsets[0] > tensor.meta.offsets[1] || tensor.meta.offsets[1] > data_size) {
+            throw std::runtime_error("Invalid offsets for tensor " + name + " in " + this->file_path);
+        }
+        tensor.meta.size = 1;
+        for (size_t dim : tensor.meta.shape) {
+            tensor.meta.size *= dim;
+        }
+        tensor.meta.byte_size = tensor.meta.offsets[1] - tensor.meta.offsets[0];
+        tensor.data = data_start + tensor.meta.offsets[0];
+        this->tensors.push_back(std::move(tensor));
+    }
+    // nlohmann::json sorts the keys, the data offsets give the order of the tensors in the file
+    std::sort(this->tensors.begin(), this->tensors.end(), [](const tensor_view& a, const tensor_view& b) {
+        return a.meta.offsets[0] < b.meta.offsets[0];
+    });
+    for (size_t i = 0; i < this->tensors.size(); i++) {
+        this->tensor_index[this->tensors[i].meta.name] = i;
+    }
+}
+
+/// \brief Check if a tensor exists
+/// \param tensor_name the tensor name
+/// \return true if the tensor exists
+bool MappedSafeTensors::contains(const std::string& tensor_name) const {
+    return this->tensor_index.find(tensor_name) != this->tensor_index.end();
+}
+
+/// \brief Get a tensor
+/// \param tensor_name the tensor name
+/// \return the view
+const tensor_view& MappedSafeTensors::get_tensor(const std::string& tensor_name) const {
+    auto it = this->tensor_index.find(tensor_name);
+    if (it == this->tensor_index.end()) {
+        throw std::out_of_range("Tensor not found: " + tensor_name);
+    }
+    return this->tensors[it->second];
+}
+
+/// \brief Get the metadata
+/// \return the metadata
+nlohmann::json MappedSafeTensors::get_metadata() const {
+    return this->metadata;
+}
+
+/// \brief Hint the access pattern of the whole file
+/// \param advice the hint
+void MappedSafeTensors::advise(mapped_advice_t advice) const {
+    this->file.advise(advice);
+}
+
+/// \brief Hint the access pattern of one tensor
+/// \param tensor_name the tensor name
+/// \param advice the hint
+void MappedSafeTensors::advise(const std::string& tensor_name, mapped_advice_t advice) const {
+    const tensor_view& tensor = this->get_tensor(tensor_name);
+    this->file.advise(advice, (size_t)(tensor.data - this->file.data()), tensor.meta.byte_size);
+}
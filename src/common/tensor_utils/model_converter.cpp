@@ -0,0 +1,266 @@
+/// \file model_converter.cpp
+/// \brief ModelConverter class
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note The output layout is known before any tensor is converted, so the header is written first and workers fill it in any order.
+#include "tensor_utils/model_converter.hpp"
+#include "tensor_utils/q4nx_kernels.hpp"
+#include "tensor_utils/safe_tensors_writer.hpp"
+#include "model_list.hpp"
+#include "utils/utils.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/// \brief one row range of one tensor
+typedef struct {
+    size_t tensor;
+    size_t row_begin;
+    size_t row_end;
+} convert_item_t;
+
+/// \brief one input tensor and where it goes
+typedef struct {
+    const tensor_view* view;
+    bool quantized;
+    bool to_bf16;
+    size_t rows;
+    size_t row_values;
+    std::atomic<size_t> items_left;
+} convert_tensor_t;
+
+/// \brief check if a dtype is converted to floats
+bool is_float(const std::string& dtype) {
+    return dtype == "F32" || dtype == "F16" || dtype == "BF16";
+}
+
+/// \brief fp16 bits to fp32
+float half_to_float(u16 h) {
+    u32 sign = (u32)(h & 0x8000) << 16;
+    u32 exponent = (h >> 10) & 0x1F;
+    u32 mantissa = h & 0x3FF;
+    if (exponent == 0x1F) {
+        return std::bit_cast<float>(sign | 0x7F800000u | (mantissa << 13));
+    }
+    if (exponent == 0) {
+        // Subnormal, the value is mantissa * 2^-24
+        float value = (float)mantissa * 5.9604644775390625e-8f;
+        return sign ? -value : value;
+    }
+    return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+/// \brief read float values of a tensor
+/// \param out the output
+/// \param data the first value
+/// \param dtype the dtype, F32, F16 or BF16
+/// \param count the number of values
+void to_float(float* out, const uint8_t* data, const std::string& dtype, size_t count) {
+    if (dtype == "F32") {
+        std::memcpy(out, data, count * sizeof(float));
+    } else if (dtype == "BF16") {
+        for (size_t i = 0; i < count; i++) {
+            u16 bits;
+            std::memcpy(&bits, data + 2 * i, sizeof(bits));
+            out[i] = std::bit_cast<float>((u32)bits << 16);
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            u16 bits;
+            std::memcpy(&bits, data + 2 * i, sizeof(bits));
+            out[i] = half_to_float(bits);
+        }
+    }
+}
+
+/// \brief check if a name ends with a suffix
+bool ends_with(const std::string& name, const std::string& suffix) {
+    return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace
+
+/// \brief Constructor
+/// \param input the checkpoint
+/// \param options the options
+ModelConverter::ModelConverter(const ShardedSafeTensors& input, const model_convert_options_t& options)
+    : input(input), options(options) {
+    if (this->options.threads <= 0) {
+        this->options.threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    }
+    this->options.chunk_values = std::max<size_t>(this->options.chunk_values, Q4NX_GROUP_SIZE);
+}
+
+/// \brief Check if a tensor is quantized
+/// \param meta the tensor metadata
+/// \return true if the tensor is quantized
+bool ModelConverter::is_quantizable(const tensor_metadata& meta) {
+    // Embeddings are gathered on the CPU and norms are tiny, both stay in BF16
+    return meta.shape.size() == 2 && is_float(meta.dtype) && ends_with(meta.name, ".weight")
+        && meta.shape[1] % Q4NX_GROUP_SIZE == 0
+        && meta.name.find("embed") == std::string::npos && meta.name.find("norm") == std::string::npos;
+}
+
+/// \brief Convert the checkpoint
+/// \param output_path the output safe-tensors file
+/// \return the throughput
+model_convert_stats_t ModelConverter::convert(const std::string& output_path) {
+    model_convert_stats_t stats = {};
+    auto start = time_utils::now();
+    const size_t group_size = Q4NX_GROUP_SIZE;
+    const std::vector<std::string>& names = this->input.get_tensor_names();
+
+    // Plan the output layout and the work items
+    std::unique_ptr<convert_tensor_t[]> tensors(new convert_tensor_t[names.size()]);
+    std::vector<tensor_metadata> layout;
+    std::vector<convert_item_t> items;
+    for (size_t t = 0; t < names.size(); t++) {
+        convert_tensor_t& tensor = tensors[t];
+        tensor.view = &this->input.get_tensor(names[t]);
+        const tensor_metadata& meta = tensor.view->meta;
+        tensor.quantized = is_quantizable(meta);
+        tensor.to_bf16 = !tensor.quantized && is_float(meta.dtype);
+        tensor.rows = meta.shape.empty() ? 1 : std::max<size_t>(meta.shape[0], 1);
+        tensor.row_values = meta.size / tensor.rows;
+        stats.input_bytes += meta.byte_size;
+        if (tensor.quantized) {
+            size_t rows = meta.shape[0], columns = meta.shape[1];
+            layout.push_back({meta.name.substr(0, meta.name.size() - 7) + ".qweight", {rows, columns / 8}, "U32", {}, rows * columns / 8, rows * columns / 2});
+            layout.push_back({meta.name.substr(0, meta.name.size() - 7) + ".scales", {rows, columns / group_size}, "BF16", {}, rows * columns / group_size, rows * columns / group_size * sizeof(bf16)});
+            layout.push_back({meta.name.substr(0, meta.name.size() - 7) + ".qzeros", {rows, columns / group_size}, "I32", {}, rows * columns / group_size, rows * columns / group_size * sizeof(i32)});
+            stats.quantized++;
+        } else if (tensor.to_bf16) {
+            layout.push_back({meta.name, meta.shape, "BF16", {}, meta.size, meta.size * sizeof(bf16)});
+        } else {
+            layout.push_back({meta.name, meta.shape, meta.dtype, {}, meta.size, meta.byte_size});
+        }
+        size_t rows_per_item = std::max<size_t>(1, this->options.chunk_values / std::max<size_t>(tensor.row_values, 1));
+        size_t item_count = 0;
+        for (size_t row = 0; row < tensor.rows; row += rows_per_item) {
+            items.push_back({t, row, std::min(tensor.rows, row + rows_per_item)});
+            item_count++;
+        }
+        tensor.items_left.store(item_count, std::memory_order_relaxed);
+    }
+    stats.tensors = names.size();
+    for (const tensor_metadata& meta : layout) {
+        stats.output_bytes += meta.byte_size;
+    }
+
+    nlohmann::json metadata = {
+        {"format", "int4"},
+        {"group_size", std::to_string(group_size)},
+        {"flm_version", __FLM_VERSION__}
+    };
+    SafeTensorsWriter writer(output_path, layout, metadata);
+    this->input.advise(MAPPED_ADVICE_SEQUENTIAL);
+    header_print("FLM", "Converting " << names.size() << " tensors (" << stats.quantized << " quantized, group " << group_size << ") from "
+        << this->input.shard_count() << " shard(s) on " << this->options.threads << " threads");
+
+    std::atomic<size_t> next_item{0};
+    std::atomic<uint64_t> bytes_done{0};
+    std::atomic<int> reported{0};
+    std::atomic<bool> failed{false};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    auto worker = [&]() {
+        std::vector<float> values;
+        std::vector<u32> q;
+        std::vector<bf16> scale;
+        std::vector<i32> zero_point;
+        std::vector<bf16> converted;
+        try {
+            for (size_t i = next_item.fetch_add(1); i < items.size() && !failed.load(std::memory_order_relaxed); i = next_item.fetch_add(1)) {
+                const convert_item_t& item = items[i];
+                convert_tensor_t& tensor = tensors[item.tensor];
+                const tensor_metadata& meta = tensor.view->meta;
+                size_t count = (item.row_end - item.row_begin) * tensor.row_values;
+                size_t element_size = meta.size > 0 ? meta.byte_size / meta.size : 0;
+                const uint8_t* data = tensor.view->data + item.row_begin * tensor.row_values * element_size;
+                std::string base = meta.name.substr(0, meta.name.size() - (tensor.quantized ? 7 : 0));
+
+                if (tensor.quantized) {
+                    size_t groups = count / group_size;
+                    values.resize(count);
+                    q.resize(count / 8);
+                    scale.resize(groups);
+                    zero_point.resize(groups);
+                    to_float(values.data(), data, meta.dtype, count);
+                    q4nx_quantize(values.data(), q.data(), scale.data(), zero_point.data(), count);
+                    size_t first_group = item.row_begin * tensor.row_values / group_size;
+                    writer.write(base + ".qweight", q.data(), q.size() * sizeof(u32), item.row_begin * tensor.row_values / 2);
+                    writer.write(base + ".scales", scale.data(), groups * sizeof(bf16), first_group * sizeof(bf16));
+                    writer.write(base + ".qzeros", zero_point.data(), groups * sizeof(i32), first_group * sizeof(i32));
+                } else if (tensor.to_bf16 && meta.dtype != "BF16") {
+                    values.resize(count);
+                    converted.resize(count);
+                    to_float(values.data(), data, meta.dtype, count);
+                    for (size_t v = 0; v < count; v++) {
+                        converted[v] = bf16(values[v]);
+                    }
+                    writer.write(meta.name, converted.data(), count * sizeof(bf16), item.row_begin * tensor.row_values * sizeof(bf16));
+                } else {
+                    // Already in the output dtype, straight from the mapping
+                    writer.write(meta.name, data, count * element_size, item.row_begin * tensor.row_values * element_size);
+                }
+
+                // The input of a finished tensor is not needed again
+                if (tensor.items_left.fetch_sub(1) == 1) {
+                    this->input.advise(meta.name, MAPPED_ADVICE_DONTNEED);
+                }
+                uint64_t done = bytes_done.fetch_add(count * element_size) + count * element_size;
+                int percent = stats.input_bytes > 0 ? (int)(done * 10 / stats.input_bytes) * 10 : 100;
+                int last = reported.load(std::memory_order_relaxed);
+                if (percent > last && reported.compare_exchange_strong(last, percent)) {
+                    double elapsed = time_utils::duration_us(start, time_utils::now()).first / 1e6;
+                    header_print("FLM", "Converted " << percent << "%, " << std::fixed << std::setprecision(2)
+                        << (elapsed > 0.0 ? done / 1e9 / elapsed : 0.0) << " GB/s");
+                }
+            }
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            failed.store(true, std::memory_order_relaxed);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < this->options.threads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    writer.commit();
+    stats.wall_seconds = time_utils::duration_us(start, time_utils::now()).first / 1e6;
+    return stats;
+}
+
+/// \brief Print the throughput of a conversion
+/// \param stats the throughput
+void ModelConverter::print_stats(const model_convert_stats_t& stats) {
+    double seconds = stats.wall_seconds > 0.0 ? stats.wall_seconds : 1e-9;
+    header_print("FLM", "Converted " << stats.tensors << " tensors (" << stats.quantized << " quantized) in " << std::fixed << std::setprecision(2)
+        << stats.wall_seconds << " s");
+    header_print("FLM", "Read " << std::fixed << std::setprecision(2) << stats.input_bytes / 1e9 << " GB at " << stats.input_bytes / 1e9 / seconds << " GB/s, wrote "
+        << stats.output_bytes / 1e9 << " GB at " << stats.output_bytes / 1e9 / seconds << " GB/s");
+}
@@ -0,0 +1,292 @@
+/// \file q4nx_kernels.cpp
+/// \brief host-side Q4NX dequantization kernels
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note The kernels work on whole groups, so the scale and the zero point are broadcast once per group.
+#include "tensor_utils/q4nx_kernels.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// MSVC compiles any intrinsic without /arch, GCC and Clang need the target on the function
+#if defined(__GNUC__) || defined(__clang__)
+#define Q4NX_TARGET_AVX2 __attribute__((target("avx2")))
+#define Q4NX_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define Q4NX_TARGET_AVX2
+#define Q4NX_TARGET_AVX512
+#endif
+
+namespace {
+
+/// \brief values per thread below which splitting a tensor costs more than it saves
+const size_t VALUES_PER_THREAD = 256 * 1024;
+
+/// \brief a kernel, dequantizes groups [group_begin, group_end)
+typedef void (*dequantize_kernel_t)(u16* weight, const u32* q, const u16* scale, const i32* zero_point, size_t group_begin, size_t group_end, size_t group_size);
+
+/// \brief fp32 to bf16 bits, round to nearest even, same as bf16_t(float)
+inline u16 round_bf16(float value) {
+    u32 bits = std::bit_cast<u32>(value);
+    return (u16)((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+}
+
+/// \brief the reference kernel
+void dequantize_scalar(u16* weight, const u32* q, const u16* scale, const i32* zero_point, size_t group_begin, size_t group_end, size_t group_size) {
+    for (size_t g = group_begin; g < group_end; g++) {
+        float s = std::bit_cast<float>((u32)scale[g] << 16);
+        i32 zp = zero_point[g];
+        const u32* words = q + g * group_size / 8;
+        u16* out = weight + g * group_size;
+        for (size_t w = 0; w < group_size / 8; w++) {
+            u32 word = words[w];
+            for (int i = 0; i < 8; i++) {
+                out[w * 8 + i] = round_bf16((float)((i32)((word >> (4 * i)) & 0xF) - zp) * s);
+            }
+        }
+    }
+}
+
+/// \brief 8 values of one word to rounded bf16 bits in 32-bit lanes
+Q4NX_TARGET_AVX2 inline __m256i dequantize_word_avx2(u32 word, __m256i shifts, __m256i zp, __m256 s) {
+    __m256i nibbles = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32((int)word), shifts), _mm256_set1_epi32(0xF));
+    __m256 value = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(nibbles, zp)), s);
+    __m256i bits = _mm256_castps_si256(value);
+    __m256i bias = _mm256_add_epi32(_mm256_set1_epi32(0x7FFF), _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1)));
+    return _mm256_srli_epi32(_mm256_add_epi32(bits, bias), 16);
+}
+
+/// \brief the AVX2 kernel, 16 values per step
+Q4NX_TARGET_AVX2 void dequantize_avx2(u16* weight, const u32* q, const u16* scale, const i32* zero_point, size_t group_begin, size_t group_end, size_t group_size) {
+    const __m256i shifts = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+    const size_t words = group_size / 8;
+    for (size_t g = group_begin; g < group_end; g++) {
+        const __m256 s = _mm256_set1_ps(std::bit_cast<float>((u32)scale[g] << 16));
+        const __m256i zp = _mm256_set1_epi32(zero_point[g]);
+        const u32* in = q + g * words;
+        u16* out = weight + g * group_size;
+        size_t w = 0;
+        for (; w + 2 <= words; w += 2) {
+            __m256i lo = dequantize_word_avx2(in[w], shifts, zp, s);
+            __m256i hi = dequantize_word_avx2(in[w + 1], shifts, zp, s);
+            // packus interleaves the 128-bit lanes, the permute puts them back in order
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + w * 8), packed);
+        }
+        if (w < words) {
+            __m256i lo = dequantize_word_avx2(in[w], shifts, zp, s);
+            __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + w * 8), packed);
+        }
+    }
+}
+
+/// \brief 16 values of two words to rounded bf16 bits
+Q4NX_TARGET_AVX512 inline __m256i dequantize_words_avx512(u32 lo, u32 hi, __m512i shifts, __m512i zp, __m512 s) {
+    __m512i words = _mm512_inserti64x4(_mm512_castsi256_si512(_mm256_set1_epi32((int)lo)), _mm256_set1_epi32((int)hi), 1);
+    __m512i nibbles = _mm512_and_si512(_mm512_srlv_epi32(words, shifts), _mm512_set1_epi32(0xF));
+    __m512 value = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_sub_epi32(nibbles, zp)), s);
+    __m512i bits = _mm512_castps_si512(value);
+    __m512i bias = _mm512_add_epi32(_mm512_set1_epi32(0x7FFF), _mm512_and_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(1)));
+    return _mm512_cvtepi32_epi16(_mm512_srli_epi32(_mm512_add_epi32(bits, bias), 16));
+}
+
+/// \brief the AVX-512 kernel, 32 values per step
+Q4NX_TARGET_AVX512 void dequantize_avx512(u16* weight, const u32* q, const u16* scale, const i32* zero_point, size_t group_begin, size_t group_end, size_t group_size) {
+    const __m512i shifts = _mm512_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28, 0, 4, 8, 12, 16, 20, 24, 28);
+    const size_t words = group_size / 8;
+    for (size_t g = group_begin; g < group_end; g++) {
+        const __m512 s = _mm512_set1_ps(std::bit_cast<float>((u32)scale[g] << 16));
+        const __m512i zp = _mm512_set1_epi32(zero_point[g]);
+        const u32* in = q + g * words;
+        u16* out = weight + g * group_size;
+        size_t w = 0;
+        for (; w + 4 <= words; w += 4) {
+            __m256i a = dequantize_words_avx512(in[w], in[w + 1], shifts, zp, s);
+            __m256i b = dequantize_words_avx512(in[w + 2], in[w + 3], shifts, zp, s);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + w * 8), a);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + w * 8 + 16), b);
+        }
+        for (; w + 2 <= words; w += 2) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + w * 8), dequantize_words_avx512(in[w], in[w + 1], shifts, zp, s));
+        }
+        if (w < words) {
+            __m256i last = dequantize_words_avx512(in[w], 0, shifts, zp, s);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + w * 8), _mm256_castsi256_si128(last));
+        }
+    }
+}
+
+/// \brief check the CPU and the OS, the OS has to save the wide registers on a context switch
+q4nx_isa_t detect_isa() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return Q4NX_ISA_SCALAR;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) {
+        return Q4NX_ISA_SCALAR;
+    }
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    bool avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+    return avx512 ? Q4NX_ISA_AVX512 : (avx2 ? Q4NX_ISA_AVX2 : Q4NX_ISA_SCALAR);
+#elif defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return Q4NX_ISA_AVX512;
+    }
+    return __builtin_cpu_supports("avx2") ? Q4NX_ISA_AVX2 : Q4NX_ISA_SCALAR;
+#else
+    return Q4NX_ISA_SCALAR;
+#endif
+}
+
+/// \brief the kernel of an instruction set
+dequantize_kernel_t select_kernel(q4nx_isa_t isa) {
+    switch (isa) {
+        case Q4NX_ISA_AVX512: return dequantize_avx512;
+        case Q4NX_ISA_AVX2: return dequantize_avx2;
+        default: return dequantize_scalar;
+    }
+}
+
+} // namespace
+
+/// \brief the best instruction set the CPU and the OS support
+/// \return the instruction set
+q4nx_isa_t q4nx_detect_isa() {
+    static const q4nx_isa_t isa = detect_isa();
+    return isa;
+}
+
+/// \brief check if the CPU and the OS support an instruction set
+/// \param isa the instruction set
+/// \return true if the kernel can run
+bool q4nx_isa_supported(q4nx_isa_t isa) {
+    return isa <= q4nx_detect_isa();
+}
+
+/// \brief name of an instruction set
+/// \param isa the instruction set
+/// \return the name
+const char* q4nx_isa_name(q4nx_isa_t isa) {
+    switch (isa) {
+        case Q4NX_ISA_AVX512: return "avx512";
+        case Q4NX_ISA_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+/// \brief Dequantize int4 weights to bf16
+/// \param weight the output
+/// \param q the packed weights
+/// \param scale the scales
+/// \param zero_point the zero points
+/// \param count the number of values
+/// \param threads the number of threads
+/// \param isa the kernel
+void q4nx_dequantize_bf16(bf16* weight, const u32* q, const bf16* scale, const i32* zero_point, size_t count, int threads, q4nx_isa_t isa) {
+    const size_t group_size = Q4NX_GROUP_SIZE;
+    if (count % group_size != 0) {
+        throw std::invalid_argument("Q4NX dequantize: count " + std::to_string(count) + " is not a multiple of " + std::to_string(group_size));
+    }
+    dequantize_kernel_t kernel = select_kernel(std::min(isa, q4nx_detect_isa()));
+    u16* out = bf16::reinterpret_to_u16(weight);
+    const u16* scales = bf16::reinterpret_to_u16(scale);
+    size_t groups = count / group_size;
+
+    if (threads <= 0) {
+        threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    }
+    threads = (int)std::min<size_t>((size_t)threads, std::max<size_t>(count / VALUES_PER_THREAD, 1));
+    if (threads == 1) {
+        kernel(out, q, scales, zero_point, 0, groups, group_size);
+        return;
+    }
+
+    // Contiguous slices keep every thread on its own pages and cache lines
+    std::vector<std::thread> workers;
+    size_t per_thread = (groups + threads - 1) / threads;
+    for (int t = 1; t < threads; t++) {
+        size_t begin = std::min(groups, (size_t)t * per_thread);
+        size_t end = std::min(groups, begin + per_thread);
+        if (begin < end) {
+            workers.emplace_back(kernel, out, q, scales, zero_point, begin, end, group_size);
+        }
+    }
+    kernel(out, q, scales, zero_point, 0, std::min(groups, per_thread), group_size);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+/// \brief Dequantize int4 weights to bf16
+/// \param weight the output
+/// \param q the packed weights
+/// \param scale the scales
+/// \param zero_point the zero points
+/// \param columns the columns
+/// \param threads the number of threads
+void q4nx_dequantize_bf16(buffer<bf16>& weight, buffer<u32>& q, buffer<bf16>& scale, buffer<i32>& zero_point, const int columns, int threads) {
+    // Sized from the scales like Q4NX::q4nx_dequantize, every other buffer has to agree
+    size_t count = scale.size() * Q4NX_GROUP_SIZE;
+    if (columns <= 0 || columns % Q4NX_GROUP_SIZE != 0 || count % columns != 0
+        || q.size() * 8 != count || zero_point.size() != scale.size()) {
+        throw std::invalid_argument("Q4NX dequantize: buffer sizes do not match " + std::to_string(columns) + " columns");
+    }
+    if (weight.size() != count) {
+        weight.resize(count);
+    }
+    q4nx_dequantize_bf16(weight.data(), q.data(), scale.data(), zero_point.data(), count, threads);
+}
+
+/// \brief Quantize fp32 weights to int4
+/// \param weight the input
+/// \param q the packed weights
+/// \param scale the scales
+/// \param zero_point the zero points
+/// \param count the number of values
+void q4nx_quantize(const float* weight, u32* q, bf16* scale, i32* zero_point, size_t count) {
+    const size_t group_size = Q4NX_GROUP_SIZE;
+    if (count % group_size != 0) {
+        throw std::invalid_argument("Q4NX quantize: count " + std::to_string(count) + " is not a multiple of " + std::to_string(group_size));
+    }
+    for (size_t g = 0; g < count / group_size; g++) {
+        const float* in = weight + g * group_size;
+        float lo = 0.0f, hi = 0.0f;
+        for (size_t i = 0; i < group_size; i++) {
+            lo = std::min(lo, in[i]);
+            hi = std::max(hi, in[i]);
+        }
+        // The range always holds 0, so zero weights stay exactly zero
+        bf16 s = bf16((hi - lo) / 15.0f);
+        float step = s.as_float();
+        float inv = step > 0.0f ? 1.0f / step : 0.0f;
+        i32 zp = std::min(std::max((i32)std::lround(-lo * inv), 0), 15);
+        scale[g].value = s.value;
+        zero_point[g] = zp;
+        u32* out = q + g * group_size / 8;
+        for (size_t w = 0; w < group_size / 8; w++) {
+            u32 word = 0;
+            for (int i = 0; i < 8; i++) {
+                i32 value = std::min(std::max((i32)std::lround(in[w * 8 + i] * inv) + zp, 0), 15);
+                word |= (u32)value << (4 * i);
+            }
+            out[w] = word;
+        }
+    }
+}
@@ -0,0 +1,142 @@
+/// \file safe_tensors_writer.cpp
+/// \brief SafeTensorsWriter class
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Layout: 8-byte little-endian header length, JSON header padded with spaces to 8 bytes, then the tensor data.
+#include "tensor_utils/safe_tensors_writer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <filesystem>
+#include <stdexcept>
+
+/// \brief Constructor
+/// \param file_path the output file
+/// \param tensors the tensors
+/// \param metadata the __metadata__ entry
+SafeTensorsWriter::SafeTensorsWriter(const std::string& file_path, const std::vector<tensor_metadata>& tensors, const nlohmann::json& metadata) {
+    this->file_path = file_path;
+    this->temp_path = file_path + ".tmp";
+    this->written = 0;
+    this->committed = false;
+
+    nlohmann::ordered_json header = nlohmann::ordered_json::object();
+    if (!metadata.empty()) {
+        header["__metadata__"] = metadata;
+    }
+    size_t offset = 0;
+    for (const tensor_metadata& tensor : tensors) {
+        tensor_metadata entry = tensor;
+        entry.offsets = {offset, offset + tensor.byte_size};
+        offset += tensor.byte_size;
+        header[entry.name] = {{"dtype", entry.dtype}, {"shape", entry.shape}, {"data_offsets", entry.offsets}};
+        this->tensor_index[entry.name] = this->tensors_data.size();
+        this->tensors_data.push_back(std::move(entry));
+    }
+    this->data_size = offset;
+    this->covered.resize(this->tensors_data.size());
+
+    std::string header_text = header.dump();
+    header_text.append((8 - header_text.size() % 8) % 8, ' ');
+    uint64_t header_size = header_text.size();
+    this->data_start = 8 + header_text.size();
+
+    this->file.open(this->temp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!this->file.is_open()) {
+        throw std::runtime_error("Failed to create file: " + this->temp_path);
+    }
+    char size_bytes[8];
+    for (int i = 0; i < 8; i++) {
+        size_bytes[i] = (char)((header_size >> (8 * i)) & 0xFF);
+    }
+    this->file.write(size_bytes, sizeof(size_bytes));
+    this->file.write(header_text.data(), (std::streamsize)header_text.size());
+    if (!this->file) {
+        throw std::runtime_error("Failed to write file: " + this->temp_path);
+    }
+}
+
+/// \brief Destructor
+SafeTensorsWriter::~SafeTensorsWriter() {
+    if (!this->committed) {
+        if (this->file.is_open()) {
+            this->file.close();
+        }
+        std::error_code ec;
+        std::filesystem::remove(this->temp_path, ec);
+    }
+}
+
+/// \brief Write a tensor or a part of it
+/// \param tensor_name the tensor name
+/// \param data the bytes
+/// \param size the number of bytes
+/// \param offset the offset in the tensor
+void SafeTensorsWriter::write(const std::string& tensor_name, const void* data, size_t size, size_t offset) {
+    auto it = this->tensor_index.find(tensor_name);
+    if (it == this->tensor_index.end()) {
+        throw std::runtime_error("Tensor not in the layout: " + tensor_name);
+    }
+    const tensor_metadata& tensor = this->tensors_data[it->second];
+    if (offset + size > tensor.byte_size) {
+        throw std::runtime_error("Write past the end of tensor " + tensor_name);
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->file.seekp((std::streamoff)(this->data_start + tensor.offsets[0] + offset));
+    this->file.write(static_cast<const char*>(data), (std::streamsize)size);
+    if (!this->file) {
+        throw std::runtime_error("Failed to write file: " + this->temp_path);
+    }
+    this->mark_covered(it->second, offset, offset + size);
+}
+
+/// \brief Record [begin, end) of a tensor as written, merging it with the ranges it touches
+/// \param index the tensor index
+/// \param begin the first byte
+/// \param end one past the last byte
+void SafeTensorsWriter::mark_covered(size_t index, size_t begin, size_t end) {
+    if (begin >= end) {
+        return;
+    }
+    std::map<size_t, size_t>& ranges = this->covered[index];
+    auto it = ranges.upper_bound(begin);
+    if (it != ranges.begin() && std::prev(it)->second >= begin) {
+        --it;
+    }
+    size_t added = end - begin;
+    while (it != ranges.end() && it->first <= end) {
+        added -= std::min(it->second, end) - std::max(it->first, begin);
+        begin = std::min(begin, it->first);
+        end = std::max(end, it->second);
+        it = ranges.erase(it);
+    }
+    ranges.emplace(begin, end);
+    this->written += added;
+}
+
+/// \brief Finish the file and move it to its final path
+void SafeTensorsWriter::commit() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (size_t i = 0; i < this->tensors_data.size(); i++) {
+        const tensor_metadata& tensor = this->tensors_data[i];
+        const std::map<size_t, size_t>& ranges = this->covered[i];
+        size_t hole = 0;
+        if (!ranges.empty() && ranges.begin()->first == 0) {
+            hole = ranges.begin()->second;
+        }
+        if (hole < tensor.byte_size) {
+            throw std::runtime_error("Incomplete file " + this->file_path + ": tensor " + tensor.name + " has no data at byte " + std::to_string(hole) + " of " + std::to_string(tensor.byte_size));
+        }
+    }
+    this->file.close();
+    if (this->file.fail()) {
+        throw std::runtime_error("Failed to write file: " + this->temp_path);
+    }
+    std::error_code ec;
+    std::filesystem::rename(this->temp_path, this->file_path, ec);
+    if (ec) {
+        throw std::runtime_error("Failed to rename " + this->temp_path + ": " + ec.message());
+    }
+    this->committed = true;
+}
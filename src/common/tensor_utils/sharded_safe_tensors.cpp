@@ -0,0 +1,120 @@
+/// \file sharded_safe_tensors.cpp
+/// \brief ShardedSafeTensors class
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Index layout: {"metadata": {...}, "weight_map": {"tensor name": "shard file", ...}}
+#include "tensor_utils/sharded_safe_tensors.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+/// \brief Constructor
+/// \param path a model directory, an index file or a single safe-tensors file
+ShardedSafeTensors::ShardedSafeTensors(const std::string& path) {
+    this->path = path;
+    std::filesystem::path fs_path(path);
+    if (std::filesystem::is_directory(fs_path)) {
+        if (std::filesystem::exists(fs_path / SAFETENSORS_INDEX_FILE)) {
+            this->_open_index((fs_path / SAFETENSORS_INDEX_FILE).string());
+        } else {
+            this->_open_single((fs_path / "model.safetensors").string());
+        }
+    } else if (path.size() > 11 && path.compare(path.size() - 11, 11, ".index.json") == 0) {
+        this->_open_index(path);
+    } else {
+        this->_open_single(path);
+    }
+    std::sort(this->tensor_names.begin(), this->tensor_names.end());
+}
+
+/// \brief Open the shards listed in an index
+/// \param index_path the index file
+void ShardedSafeTensors::_open_index(const std::string& index_path) {
+    std::ifstream file(index_path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + index_path);
+    }
+    nlohmann::json index = nlohmann::json::parse(file);
+    if (!index.contains("weight_map") || !index["weight_map"].is_object()) {
+        throw std::runtime_error("Invalid safetensors index, no weight_map: " + index_path);
+    }
+    if (index.contains("metadata")) {
+        this->metadata = index["metadata"];
+    }
+    std::filesystem::path directory = std::filesystem::path(index_path).parent_path();
+    std::unordered_map<std::string, size_t> shard_index;
+    for (auto& [name, shard_file] : index["weight_map"].items()) {
+        std::string file_name = shard_file.get<std::string>();
+        auto it = shard_index.find(file_name);
+        if (it == shard_index.end()) {
+            // Shards are mapped once, the index lists every tensor of a shard with the same file
+            it = shard_index.emplace(file_name, this->shards.size()).first;
+            this->shards.push_back(std::make_unique<MappedSafeTensors>((directory / file_name).string()));
+            this->shard_files.push_back(file_name);
+        }
+        if (!this->shards[it->second]->contains(name)) {
+            throw std::runtime_error("Tensor " + name + " is not in shard " + file_name);
+        }
+        this->tensor_shard[name] = it->second;
+        this->tensor_names.push_back(name);
+    }
+}
+
+/// \brief Open a single-file checkpoint as one shard
+/// \param file_path the safe-tensors file
+void ShardedSafeTensors::_open_single(const std::string& file_path) {
+    this->shards.push_back(std::make_unique<MappedSafeTensors>(file_path));
+    this->shard_files.push_back(std::filesystem::path(file_path).filename().string());
+    this->metadata = this->shards[0]->get_metadata();
+    for (const tensor_view& tensor : this->shards[0]->get_tensors()) {
+        this->tensor_shard[tensor.meta.name] = 0;
+        this->tensor_names.push_back(tensor.meta.name);
+    }
+}
+
+/// \brief Check if a tensor exists
+/// \param tensor_name the tensor name
+/// \return true if the tensor exists
+bool ShardedSafeTensors::contains(const std::string& tensor_name) const {
+    return this->tensor_shard.find(tensor_name) != this->tensor_shard.end();
+}
+
+/// \brief Get a tensor
+/// \param tensor_name the tensor name
+/// \return the view
+const tensor_view& ShardedSafeTensors::get_tensor(const std::string& tensor_name) const {
+    auto it = this->tensor_shard.find(tensor_name);
+    if (it == this->tensor_shard.end()) {
+        throw std::out_of_range("Tensor not found: " + tensor_name);
+    }
+    return this->shards[it->second]->get_tensor(tensor_name);
+}
+
+/// \brief Hint the access pattern of every shard
+/// \param advice the hint
+void ShardedSafeTensors::advise(mapped_advice_t advice) const {
+    for (const auto& shard : this->shards) {
+        shard->advise(advice);
+    }
+}
+
+/// \brief Hint the access pattern of one tensor
+/// \param tensor_name the tensor name
+/// \param advice the hint
+void ShardedSafeTensors::advise(const std::string& tensor_name, mapped_advice_t advice) const {
+    auto it = this->tensor_shard.find(tensor_name);
+    if (it != this->tensor_shard.end()) {
+        this->shards[it->second]->advise(tensor_name, advice);
+    }
+}
+
+/// \brief Bytes of tensor data over all shards
+size_t ShardedSafeTensors::total_bytes() const {
+    size_t total = 0;
+    for (const auto& [name, shard] : this->tensor_shard) {
+        total += this->shards[shard]->get_tensor(name).meta.byte_size;
+    }
+    return total;
+}
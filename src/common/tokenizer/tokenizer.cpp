@@ -4,6 +4,8 @@
 /// \date 2025-06-24
 /// \version 0.9.7
 #include "tokenizer/tokenizer.hpp"
+#include "utils/debug_utils.hpp"
+#include "utils/mapped_file.hpp"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -11,13 +13,41 @@
 #include <cstdint>
 #include <unordered_map>
 #include <regex>
+#include <cstring>
+#include <filesystem>
 
-/// \brief Constructor
-/// \param model_path the model path
-Tokenizer::Tokenizer(const std::string& model_path) {
-    std::ifstream fs(model_path + "/tokenizer.json", std::ios::in | std::ios::binary);
+namespace {
+
+/// \brief version of the tokenizer cache layout, bump it when the layout or its contents change
+const uint32_t TOKENIZER_CACHE_VERSION = 1;
+
+/// \brief header of the tokenizer cache
+/// \note Followed by eos_count int32 ids, vocab_size + 1 uint32 offsets into the token bytes,
+///       the length-prefixed bos, eos, boi, eoi and image tokens and chat template, then the token bytes
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;             // bit 0: ByteLevel decoder, bit 1: has a BOS token
+    uint64_t tokenizer_size;    // size of tokenizer.json
+    int64_t tokenizer_mtime;    // write time of tokenizer.json
+    uint64_t config_size;       // size of tokenizer_config.json
+    int64_t config_mtime;       // write time of tokenizer_config.json
+    int32_t bos_token_id;
+    int32_t think_marker_id;
+    uint32_t eos_count;
+    uint32_t vocab_size;
+    uint64_t token_bytes_size;
+} tokenizer_cache_header_t;
+
+const char TOKENIZER_CACHE_MAGIC[8] = {'F', 'L', 'M', 'T', 'O', 'K', 'C', '\0'};
+
+/// \brief Read a whole file
+/// \param path the path
+/// \return the content
+std::string read_whole_file(const std::string& path) {
+    std::ifstream fs(path, std::ios::in | std::ios::binary);
     if (fs.fail()) {
-        std::cerr << "Cannot open " << model_path + "/tokenizer.json" << std::endl;
+        std::cerr << "Cannot open " << path << std::endl;
         exit(1);
     }
     std::string data;
@@ -26,62 +56,108 @@ Tokenizer::Tokenizer(const std::string& model_path) {
     fs.seekg(0, std::ios::beg);
     data.resize(size);
     fs.read(data.data(), size);
-    this->tokenizer = tokenizers::Tokenizer::FromBlobJSON(data);
-    fs.close();
-    std::string decoder_type;
-    nlohmann::json data_json = nlohmann::json::parse(data);
-    JSON_GET(decoder_type, data_json["decoder"], "type", "ByteLevel", std::string);
-    if (decoder_type == "ByteLevel") {
-        this->is_doubled_encoded = true;
-    }
-    else {
-        this->is_doubled_encoded = false;
+    return data;
+}
+
+/// \brief Size and write time of a file, the cache is stale when they change
+/// \param path the path
+/// \param size the size
+/// \param mtime the write time
+void file_stamp(const std::string& path, uint64_t& size, int64_t& mtime) {
+    std::error_code ec;
+    size = (uint64_t)std::filesystem::file_size(path, ec);
+    if (ec) {
+        size = 0;
     }
-    // load tokenizer configurations
-    std::ifstream fs_config(model_path + "/tokenizer_config.json", std::ios::in | std::ios::binary);
-    if (fs_config.fail()) {
-        std::cerr << "Cannot open " << model_path + "/tokenizer_config.json" << std::endl;
-        exit(1);
+    auto time = std::filesystem::last_write_time(path, ec);
+    mtime = ec ? 0 : (int64_t)time.time_since_epoch().count();
+}
+
+/// \brief Append a length-prefixed string
+void put_string(std::string& out, const std::string& value) {
+    uint32_t length = (uint32_t)value.size();
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out += value;
+}
+
+/// \brief Read a length-prefixed string
+/// \return false if it runs past the end
+bool get_string(const uint8_t*& cursor, const uint8_t* end, std::string& value) {
+    uint32_t length;
+    if ((size_t)(end - cursor) < sizeof(length)) {
+        return false;
     }
-    std::string data_config;
-    fs_config.seekg(0, std::ios::end);
-    size_t size_config = static_cast<size_t>(fs_config.tellg());
-    fs_config.seekg(0, std::ios::beg);
-    data_config.resize(size_config);
-    fs_config.read(data_config.data(), size_config);
-    fs_config.close();
-    auto tokenizer_config = nlohmann::json::parse(data_config);
-    // check if bos_token is null
-    if (tokenizer_config["bos_token"].is_null()) {
-        this->has_bos_token = false;
+    std::memcpy(&length, cursor, sizeof(length));
+    cursor += sizeof(length);
+    if ((size_t)(end - cursor) < length) {
+        return false;
     }
-    else {
-        this->has_bos_token = true;
+    value.assign(reinterpret_cast<const char*>(cursor), length);
+    cursor += length;
+    return true;
+}
+
+} // namespace
+
+/// \brief Constructor
+/// \param model_path the model path
+/// \note tokenizer.json is read and parsed by FromBlobJSON on every load, cached or not, the tokenizers
+///       library has no other entry point. A fresh cache only skips the nlohmann parse of both JSON files and the table build
+Tokenizer::Tokenizer(const std::string& model_path) {
+    std::string data = read_whole_file(model_path + "/tokenizer.json");
+    // Not skipped by the cache, this is the full vocabulary and merges parse
+    this->tokenizer = tokenizers::Tokenizer::FromBlobJSON(data);
+
+    std::string chat_template;
+    if (!this->load_cache(model_path, chat_template)) {
+        std::string decoder_type;
+        nlohmann::json data_json = nlohmann::json::parse(data);
+        JSON_GET(decoder_type, data_json["decoder"], "type", "ByteLevel", std::string);
+        if (decoder_type == "ByteLevel") {
+            this->is_doubled_encoded = true;
+        }
+        else {
+            this->is_doubled_encoded = false;
+        }
+        // load tokenizer configurations
+        auto tokenizer_config = nlohmann::json::parse(read_whole_file(model_path + "/tokenizer_config.json"));
+        // check if bos_token is null
+        if (tokenizer_config["bos_token"].is_null()) {
+            this->has_bos_token = false;
+        }
+        else {
+            this->has_bos_token = true;
+        }
+        chat_template = tokenizer_config["chat_template"].get<std::string>();
+
+        if (this->has_bos_token) {
+            this->bos_token = tokenizer_config["bos_token"].get<std::string>();
+            this->bos_token_id = tokenizer_config["bos_token_id"].get<int>();
+        }
+        else {
+            this->bos_token_id = -1;
+        }
+        this->eos_token = tokenizer_config["eos_token"].get<std::string>();
+        for (auto& token : tokenizer_config["eos_token_id"]) {
+            this->eos_token_ids.push_back(token.get<int>());
+        }
+        JSON_GET(this->think_marker_id, tokenizer_config, "think_marker_id", -1, int);
+        JSON_GET(this->boi_token, tokenizer_config, "boi_token", "", std::string);
+        JSON_GET(this->eoi_token, tokenizer_config, "eoi_token", "", std::string);
+        JSON_GET(this->image_token, tokenizer_config, "image_token", "", std::string);
+        this->build_token_table();
+        this->save_cache(model_path, chat_template);
     }
+
     // load chat template
     this->tmpl = std::make_unique<minja::chat_template>(
-        tokenizer_config["chat_template"],
-        this->has_bos_token ? tokenizer_config["bos_token"] : "",
-        tokenizer_config["eos_token"]
+        chat_template,
+        this->has_bos_token ? this->bos_token : "",
+        this->eos_token
     );
-    
-    if (this->has_bos_token) {
-        this->bos_token_id = tokenizer_config["bos_token_id"].get<int>();
-    }
-    else {
-        this->bos_token_id = -1;
-    }
-    this->eos_token = tokenizer_config["eos_token"].get<std::string>();
-    for (auto& token : tokenizer_config["eos_token_id"]) {
-        this->eos_token_ids.push_back(token.get<int>());
-    }
     this->user_system_prompt = "";
     this->extra_context["user_system_prompt"] = this->user_system_prompt;
     this->extra_context["enable_thinking"] = false;
-    JSON_GET(this->think_marker_id, tokenizer_config, "think_marker_id", -1, int);
-    JSON_GET(this->boi_token, tokenizer_config, "boi_token", "", std::string);
-    JSON_GET(this->eoi_token, tokenizer_config, "eoi_token", "", std::string);
-    JSON_GET(this->image_token, tokenizer_config, "image_token", "", std::string);
     if (!this->boi_token.empty()) {
         assert(!this->eoi_token.empty());
         assert(!this->image_token.empty());
@@ -89,11 +165,153 @@ Tokenizer::Tokenizer(const std::string& model_path) {
         this->extra_context["eoi_token"] = this->eoi_token;
         this->extra_context["image_token"] = this->image_token;
     }
+    this->prompt_cache.verified = 0;
+    this->clear_prompt_cache();
+}
+
+/// \brief Load the tokenizer cache
+/// \param model_path the model path
+/// \param chat_template the chat template source
+/// \return false if the cache is missing, stale or corrupt
+/// \note The token table is copied out and the file is closed, so the model directory can still be removed or re-downloaded
+bool Tokenizer::load_cache(const std::string& model_path, std::string& chat_template) {
+    mapped_file cache_file;
+    if (!cache_file.open(model_path + "/" + TOKENIZER_CACHE_FILE)) {
+        return false;
+    }
+    const uint8_t* cursor = cache_file.data();
+    const uint8_t* end = cursor + cache_file.size();
+    tokenizer_cache_header_t header;
+    uint64_t tokenizer_size, config_size;
+    int64_t tokenizer_mtime, config_mtime;
+    file_stamp(model_path + "/tokenizer.json", tokenizer_size, tokenizer_mtime);
+    file_stamp(model_path + "/tokenizer_config.json", config_size, config_mtime);
+    bool valid = cache_file.size() >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, cursor, sizeof(header));
+        cursor += sizeof(header);
+        valid = std::memcmp(header.magic, TOKENIZER_CACHE_MAGIC, sizeof(header.magic)) == 0
+             && header.version == TOKENIZER_CACHE_VERSION
+             && header.tokenizer_size == tokenizer_size && header.tokenizer_mtime == tokenizer_mtime
+             && header.config_size == config_size && header.config_mtime == config_mtime
+             && header.vocab_size == this->tokenizer->GetVocabSize();
+    }
+    size_t table_bytes = valid ? (size_t)header.eos_count * sizeof(int32_t) + ((size_t)header.vocab_size + 1) * sizeof(uint32_t) : 0;
+    valid = valid && (size_t)(end - cursor) >= table_bytes;
+    if (valid) {
+        this->eos_token_ids.resize(header.eos_count);
+        std::memcpy(this->eos_token_ids.data(), cursor, header.eos_count * sizeof(int32_t));
+        cursor += header.eos_count * sizeof(int32_t);
+        this->token_table_offsets = reinterpret_cast<const uint32_t*>(cursor);
+        cursor += ((size_t)header.vocab_size + 1) * sizeof(uint32_t);
+        valid = get_string(cursor, end, this->bos_token) && get_string(cursor, end, this->eos_token)
+             && get_string(cursor, end, this->boi_token) && get_string(cursor, end, this->eoi_token)
+             && get_string(cursor, end, this->image_token) && get_string(cursor, end, chat_template)
+             && (uint64_t)(end - cursor) == header.token_bytes_size
+             && this->token_table_offsets[header.vocab_size] == header.token_bytes_size;
+    }
+    if (!valid) {
+        header_print_debug("FLM", "Tokenizer cache is missing or stale, parsing the JSON files");
+        this->eos_token_ids.clear();
+        this->token_table_offsets = nullptr;
+        return false;
+    }
+    this->token_offsets.assign(this->token_table_offsets, this->token_table_offsets + header.vocab_size + 1);
+    this->token_bytes.assign(reinterpret_cast<const char*>(cursor), header.token_bytes_size);
+    this->token_table_offsets = this->token_offsets.data();
+    this->token_table = this->token_bytes;
+    this->token_table_size = header.vocab_size;
+    this->is_doubled_encoded = (header.flags & 1) != 0;
+    this->has_bos_token = (header.flags & 2) != 0;
+    this->bos_token_id = header.bos_token_id;
+    this->think_marker_id = header.think_marker_id;
+    header_print_debug("FLM", "Tokenizer cache loaded: " << header.vocab_size << " tokens");
+    return true;
+}
+
+/// \brief Write the tokenizer cache
+/// \param model_path the model path
+/// \param chat_template the chat template source
+/// \note Written to a temporary file and renamed, a read-only model directory only costs the cache
+void Tokenizer::save_cache(const std::string& model_path, const std::string& chat_template) {
+    tokenizer_cache_header_t header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TOKENIZER_CACHE_MAGIC, sizeof(header.magic));
+    header.version = TOKENIZER_CACHE_VERSION;
+    header.flags = (this->is_doubled_encoded ? 1u : 0u) | (this->has_bos_token ? 2u : 0u);
+    file_stamp(model_path + "/tokenizer.json", header.tokenizer_size, header.tokenizer_mtime);
+    file_stamp(model_path + "/tokenizer_config.json", header.config_size, header.config_mtime);
+    header.bos_token_id = this->bos_token_id;
+    header.think_marker_id = this->think_marker_id;
+    header.eos_count = (uint32_t)this->eos_token_ids.size();
+    header.vocab_size = (uint32_t)this->token_table_size;
+    header.token_bytes_size = this->token_table.size();
+
+    std::string out;
+    out.reserve(sizeof(header) + this->token_bytes.size() + this->token_offsets.size() * sizeof(uint32_t) + chat_template.size() + 256);
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (int id : this->eos_token_ids) {
+        int32_t value = id;
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    out.append(reinterpret_cast<const char*>(this->token_table_offsets), (this->token_table_size + 1) * sizeof(uint32_t));
+    put_string(out, this->bos_token);
+    put_string(out, this->eos_token);
+    put_string(out, this->boi_token);
+    put_string(out, this->eoi_token);
+    put_string(out, this->image_token);
+    put_string(out, chat_template);
+    out.append(this->token_table.data(), this->token_table.size());
+
+    std::string path = model_path + "/" + TOKENIZER_CACHE_FILE;
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream fs(temp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!fs || !fs.write(out.data(), (std::streamsize)out.size())) {
+            header_print_debug("FLM", "Cannot write the tokenizer cache " << temp_path);
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        header_print_debug("FLM", "Cannot write the tokenizer cache " << path);
+    }
 }
 
 /// \brief Destructor
 Tokenizer::~Tokenizer() = default;
 
+/// \brief Decode every vocabulary entry into token_bytes
+/// \note Streaming detokenization becomes a lookup, no FFI call or allocation per token
+void Tokenizer::build_token_table() {
+    size_t vocab_size = this->tokenizer->GetVocabSize();
+    this->token_bytes.clear();
+    this->token_bytes.reserve(vocab_size * 8);
+    this->token_offsets.resize(vocab_size + 1);
+    size_t undecodable = 0;
+    for (size_t id = 0; id < vocab_size; id++) {
+        this->token_offsets[id] = (uint32_t)this->token_bytes.size();
+        std::string token = this->tokenizer->IdToToken((int32_t)id);
+        try {
+            this->token_bytes += this->cpt_to_utf8(token);
+        }
+        catch (const std::runtime_error&) {
+            // Not byte-level text, e.g. an added token, keep it verbatim
+            this->token_bytes += token;
+            undecodable++;
+        }
+    }
+    this->token_offsets[vocab_size] = (uint32_t)this->token_bytes.size();
+    this->token_bytes.shrink_to_fit();
+    this->token_table = this->token_bytes;
+    this->token_table_offsets = this->token_offsets.data();
+    this->token_table_size = vocab_size;
+    header_print_debug("FLM", "Token table: " << vocab_size << " tokens, " << this->token_bytes.size() << " bytes, "
+        << undecodable << " kept verbatim");
+}
+
 /// \brief Make the inverse byte map
 /// \return the inverse byte map
 std::unordered_map<uint32_t, uint8_t> Tokenizer::make_inverse_byte_map() {
@@ -201,6 +419,82 @@ std::vector<int> Tokenizer::encode(const std::string& text) {
     return this->tokenizer->Encode(text);
 }
 
+/// \brief Encode a rendered prompt, reusing the tokens it shares with the previous one
+/// \param text the rendered prompt
+/// \return the encoded tokens
+/// \note The first reuse is checked against a full encode, reuse is disabled if they differ,
+///       e.g. if the tokenizer adds special tokens by itself
+std::vector<int> Tokenizer::encode_prompt(const std::string& text) {
+    prompt_cache_t& cache = this->prompt_cache;
+    size_t common = 0;
+    size_t limit = std::min(text.size(), cache.text.size());
+    while (common < limit && text[common] == cache.text[common]) {
+        common++;
+    }
+    std::pair<size_t, size_t> cut = {0, 0};
+    if (cache.verified >= 0) {
+        for (auto& candidate : cache.cuts) {
+            if (candidate.first > common) {
+                break;
+            }
+            cut = candidate;
+        }
+    }
+
+    std::vector<int> tokens;
+    if (cut.second == 0) {
+        tokens = this->encode(text);
+    }
+    else {
+        tokens.reserve(cut.second + (text.size() - cut.first) / 2);
+        tokens.assign(cache.tokens.begin(), cache.tokens.begin() + cut.second);
+        std::vector<int> suffix = this->encode(text.substr(cut.first));
+        tokens.insert(tokens.end(), suffix.begin(), suffix.end());
+        if (cache.verified == 0) {
+            std::vector<int> full = this->encode(text);
+            cache.verified = full == tokens ? 1 : -1;
+            if (cache.verified < 0) {
+                header_print_debug("FLM", "Prompt token reuse does not match a full encode, disabled for this tokenizer");
+                tokens = std::move(full);
+            }
+        }
+        header_print_debug("FLM", "Prompt tokens reused: " << cut.second << " of " << tokens.size());
+    }
+
+    if (cache.verified >= 0) {
+        cache.text = text;
+        cache.tokens = tokens;
+        this->update_prompt_cuts();
+    }
+    return tokens;
+}
+
+/// \brief Drop the tokens kept by encode_prompt
+void Tokenizer::clear_prompt_cache() {
+    this->prompt_cache.text.clear();
+    this->prompt_cache.tokens.clear();
+    this->prompt_cache.cuts.clear();
+}
+
+/// \brief Find the restart points of the cached prompt
+/// \note A cut is only kept where the decoded token sits at the same offset in the text,
+///       so normalizers that add or drop characters leave no cut
+void Tokenizer::update_prompt_cuts() {
+    prompt_cache_t& cache = this->prompt_cache;
+    cache.cuts.clear();
+    size_t offset = 0;
+    for (size_t i = 0; i < cache.tokens.size(); i++) {
+        std::string_view piece = this->run_time_decoder_view(cache.tokens[i]);
+        if (offset + piece.size() > cache.text.size() || cache.text.compare(offset, piece.size(), piece) != 0) {
+            return;
+        }
+        offset += piece.size();
+        if (this->is_eos(cache.tokens[i])) {
+            cache.cuts.emplace_back(offset, i + 1);
+        }
+    }
+}
+
 /// \brief Decode the tokens
 /// \param tokens the tokens
 /// \return the decoded text
@@ -212,7 +506,20 @@ std::string Tokenizer::decode(const std::vector<int>& tokens) {
 /// \param answer_token the answer token
 /// \return the decoded text
 std::string Tokenizer::run_time_decoder(int answer_token) {
-    return this->cpt_to_utf8(this->tokenizer->IdToToken(answer_token));
+    return std::string(this->run_time_decoder_view(answer_token));
+}
+
+/// \brief Run time decoder without allocation
+/// \param answer_token the answer token
+/// \return the decoded bytes
+std::string_view Tokenizer::run_time_decoder_view(int answer_token) {
+    if (answer_token >= 0 && (size_t)answer_token < this->token_table_size) {
+        uint32_t begin = this->token_table_offsets[answer_token];
+        uint32_t end = this->token_table_offsets[answer_token + 1];
+        return this->token_table.substr(begin, end - begin);
+    }
+    this->token_scratch = this->cpt_to_utf8(this->tokenizer->IdToToken(answer_token));
+    return this->token_scratch;
 }
 
 /// \brief Apply the chat template
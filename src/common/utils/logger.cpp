@@ -0,0 +1,268 @@
+/// \file logger.cpp
+/// \brief leveled asynchronous logger
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Bounded MPSC ring buffer (Vyukov), producers never take a lock
+#include "utils/logger.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+std::atomic<int> g_log_level{LOG_LEVEL_INFO};
+
+namespace {
+
+/// \brief number of slots, a power of two
+const size_t LOG_SLOT_COUNT = 1024;
+/// \brief inline capacity of a slot, longer lines are moved to the heap
+/// \note Holds a 4 KB request summary with its header, so the server never allocates to log one
+const size_t LOG_SLOT_BYTES = 4608;
+
+/// \brief one log line
+typedef struct {
+    std::atomic<uint64_t> sequence;
+    uint32_t length;
+    std::string* overflow;
+    char text[LOG_SLOT_BYTES];
+} log_slot_t;
+
+/// \brief ring buffer and flusher state
+struct log_state_t {
+    log_slot_t slots[LOG_SLOT_COUNT];
+    alignas(64) std::atomic<uint64_t> enqueue_pos{0};
+    alignas(64) uint64_t dequeue_pos = 0;
+    std::atomic<uint64_t> dropped{0};          // not reported yet
+    std::atomic<uint64_t> dropped_total{0};
+    std::atomic<bool> async{false};
+    std::atomic<uint32_t> producers{0};        // log_line calls between the async check and the enqueue
+    std::atomic<bool> running{false};
+    std::thread flusher;
+    std::mutex control_mutex;
+
+    log_state_t() {
+        for (size_t i = 0; i < LOG_SLOT_COUNT; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+            slots[i].overflow = nullptr;
+        }
+    }
+
+    ~log_state_t() {
+        stop();
+    }
+
+    /// \brief claim a slot and copy the line into it
+    /// \return false if the buffer is full
+    bool enqueue(std::string_view line) {
+        uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        log_slot_t* slot;
+        for (;;) {
+            slot = &slots[pos & (LOG_SLOT_COUNT - 1)];
+            uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+            int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        if (line.size() <= LOG_SLOT_BYTES) {
+            std::memcpy(slot->text, line.data(), line.size());
+            slot->length = static_cast<uint32_t>(line.size());
+            slot->overflow = nullptr;
+        } else {
+            slot->length = 0;
+            slot->overflow = new std::string(line);
+        }
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// \brief move every published line into batch
+    /// \return the number of lines
+    size_t drain(std::string& batch) {
+        size_t count = 0;
+        for (;;) {
+            log_slot_t* slot = &slots[dequeue_pos & (LOG_SLOT_COUNT - 1)];
+            uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+            if (seq != dequeue_pos + 1) {
+                return count;
+            }
+            if (slot->overflow) {
+                batch += *slot->overflow;
+                delete slot->overflow;
+                slot->overflow = nullptr;
+            } else {
+                batch.append(slot->text, slot->length);
+            }
+            batch += '\n';
+            slot->sequence.store(dequeue_pos + LOG_SLOT_COUNT, std::memory_order_release);
+            dequeue_pos++;
+            count++;
+        }
+    }
+
+    /// \brief write a batch to stdout
+    void write_batch(std::string& batch) {
+        uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+        if (lost > 0) {
+            batch += "[LOG]  " + std::to_string(lost) + " log lines dropped\n";
+        }
+        if (!batch.empty()) {
+            std::cout.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+            std::cout.flush();
+            batch.clear();
+        }
+    }
+
+    /// \brief flusher loop, sleeps briefly whenever the buffer is empty
+    void flush_loop() {
+        std::string batch;
+        batch.reserve(64 * 1024);
+        while (running.load(std::memory_order_acquire)) {
+            if (drain(batch) == 0 && dropped.load(std::memory_order_relaxed) == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                continue;
+            }
+            write_batch(batch);
+        }
+        drain(batch);
+        write_batch(batch);
+    }
+
+    void start() {
+        std::lock_guard<std::mutex> lock(control_mutex);
+        if (running.load()) {
+            return;
+        }
+        std::cout.flush();
+        running.store(true, std::memory_order_release);
+        flusher = std::thread([this]() { flush_loop(); });
+        async.store(true, std::memory_order_release);
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lock(control_mutex);
+        if (!running.load()) {
+            return;
+        }
+        // A producer that saw async before it was cleared may still be enqueueing, the final drain has to wait for it
+        async.store(false);
+        while (producers.load() != 0) {
+            std::this_thread::yield();
+        }
+        running.store(false, std::memory_order_release);
+        if (flusher.joinable()) {
+            flusher.join();
+        }
+    }
+};
+
+/// \brief the logger state, constructed on first use
+log_state_t& log_state() {
+    static log_state_t state;
+    return state;
+}
+
+} // namespace
+
+/// \brief log one line
+/// \param level the level
+/// \param line the line
+void log_line(log_level_t level, std::string_view line) {
+    if (!log_enabled(level)) {
+        return;
+    }
+    log_state_t& state = log_state();
+    // Announce the producer before checking the mode, stop() waits for it before the last drain
+    state.producers.fetch_add(1);
+    if (state.async.load()) {
+        if (!state.enqueue(line)) {
+            state.dropped.fetch_add(1, std::memory_order_relaxed);
+            state.dropped_total.fetch_add(1, std::memory_order_relaxed);
+        }
+        state.producers.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    state.producers.fetch_sub(1, std::memory_order_release);
+    std::cout << line << std::endl;
+}
+
+/// \brief set the verbosity
+/// \param level the level
+void log_set_level(log_level_t level) {
+    g_log_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+/// \brief level name
+/// \param level the level
+/// \return the name
+const char* log_level_name(log_level_t level) {
+    switch (level) {
+        case LOG_LEVEL_ERROR: return "error";
+        case LOG_LEVEL_WARN: return "warn";
+        case LOG_LEVEL_INFO: return "info";
+        case LOG_LEVEL_DEBUG: return "debug";
+        case LOG_LEVEL_TRACE: return "trace";
+    }
+    return "info";
+}
+
+/// \brief parse a level name
+/// \param name the name
+/// \param level the parsed level
+/// \return true if the name is valid
+bool log_parse_level(const std::string& name, log_level_t& level) {
+    for (int i = LOG_LEVEL_ERROR; i <= LOG_LEVEL_TRACE; ++i) {
+        if (name == log_level_name(static_cast<log_level_t>(i)) || name == std::to_string(i)) {
+            level = static_cast<log_level_t>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/// \brief read the verbosity from the FLM_LOG_LEVEL environment variable
+void log_init_from_env() {
+    std::string value;
+#ifdef _WIN32
+    char* env = nullptr;
+    size_t len = 0;
+    if (_dupenv_s(&env, &len, "FLM_LOG_LEVEL") == 0 && env != nullptr) {
+        value = env;
+        free(env);
+    }
+#else
+    const char* env = std::getenv("FLM_LOG_LEVEL");
+    if (env != nullptr) {
+        value = env;
+    }
+#endif
+    log_level_t level;
+    if (!value.empty() && log_parse_level(value, level)) {
+        log_set_level(level);
+    }
+}
+
+/// \brief switch to asynchronous logging
+void log_start_async() {
+    log_state().start();
+}
+
+/// \brief stop the background flusher
+void log_stop_async() {
+    log_state().stop();
+}
+
+/// \brief number of lines dropped because the ring buffer was full
+/// \return the number of dropped lines
+uint64_t log_dropped_lines() {
+    return log_state().dropped_total.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,147 @@
+/// \file mapped_file.cpp
+/// \brief read-only memory-mapped files
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note CreateFileMapping on Windows, mmap elsewhere
+#include "utils/mapped_file.hpp"
+#include <utility>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/// \brief destructor, unmaps the file
+mapped_file::~mapped_file() {
+    this->close();
+}
+
+/// \brief move constructor
+mapped_file::mapped_file(mapped_file&& other) noexcept {
+    *this = std::move(other);
+}
+
+/// \brief move assignment
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+    if (this != &other) {
+        this->close();
+        std::swap(this->base, other.base);
+        std::swap(this->length, other.length);
+#ifdef _WIN32
+        std::swap(this->file, other.file);
+        std::swap(this->mapping, other.mapping);
+#endif
+    }
+    return *this;
+}
+
+/// \brief map a file
+/// \param path the path
+/// \return true on success
+bool mapped_file::open(const std::string& path) {
+    this->close();
+#ifdef _WIN32
+    // Share delete, so a model directory can be removed or re-downloaded while a file in it is mapped
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    this->file = file;
+    this->mapping = mapping;
+    this->base = static_cast<const uint8_t*>(view);
+    this->length = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    this->base = static_cast<const uint8_t*>(view);
+    this->length = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+/// \brief hint the access pattern of a range
+/// \param advice the hint
+/// \param offset the start of the range
+/// \param length the length of the range, 0 for the rest of the file
+/// \note Windows only honors MAPPED_ADVICE_WILLNEED, through PrefetchVirtualMemory
+void mapped_file::advise(mapped_advice_t advice, size_t offset, size_t length) const {
+    if (this->base == nullptr || offset >= this->length) {
+        return;
+    }
+    if (length == 0 || offset + length > this->length) {
+        length = this->length - offset;
+    }
+#ifdef _WIN32
+    if (advice == MAPPED_ADVICE_WILLNEED) {
+        WIN32_MEMORY_RANGE_ENTRY range;
+        range.VirtualAddress = const_cast<uint8_t*>(this->base + offset);
+        range.NumberOfBytes = length;
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    // madvise needs a page-aligned start
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t aligned = offset / page * page;
+    int flag = MADV_NORMAL;
+    switch (advice) {
+        case MAPPED_ADVICE_SEQUENTIAL: flag = MADV_SEQUENTIAL; break;
+        case MAPPED_ADVICE_RANDOM:     flag = MADV_RANDOM; break;
+        case MAPPED_ADVICE_WILLNEED:   flag = MADV_WILLNEED; break;
+        case MAPPED_ADVICE_DONTNEED:   flag = MADV_DONTNEED; break;
+        default:                       flag = MADV_NORMAL; break;
+    }
+    madvise(const_cast<uint8_t*>(this->base + aligned), length + (offset - aligned), flag);
+#endif
+}
+
+/// \brief unmap the file
+void mapped_file::close() {
+    if (this->base == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(this->base);
+    CloseHandle((HANDLE)this->mapping);
+    CloseHandle((HANDLE)this->file);
+    this->mapping = nullptr;
+    this->file = nullptr;
+#else
+    munmap(const_cast<uint8_t*>(this->base), this->length);
+#endif
+    this->base = nullptr;
+    this->length = 0;
+}
@@ -0,0 +1,143 @@
+/// \file metrics.cpp
+/// \brief Prometheus-style serving metrics
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Text exposition format 0.0.4
+#include "utils/metrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+flm_metrics_t g_metrics;
+
+namespace {
+
+/// \brief append a number the way Prometheus parses it
+/// \param out the output
+/// \param value the value
+void append_number(std::string& out, double value) {
+    if (std::isinf(value)) {
+        out += value > 0 ? "+Inf" : "-Inf";
+        return;
+    }
+    char text[32];
+    int n = std::snprintf(text, sizeof(text), "%.15g", value);
+    out.append(text, n > 0 ? static_cast<size_t>(n) : 0);
+}
+
+/// \brief append the HELP and TYPE lines
+/// \param out the output
+/// \param name the metric name
+/// \param help the help text
+/// \param type the metric type
+void append_header(std::string& out, const char* name, const char* help, const char* type) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+} // namespace
+
+/// \brief constructor
+/// \param bounds the upper bounds of the buckets
+metrics_histogram::metrics_histogram(std::initializer_list<double> bounds)
+    : bounds(bounds), buckets(new std::atomic<uint64_t>[bounds.size() + 1]), sum(0.0) {
+    for (size_t i = 0; i <= this->bounds.size(); ++i) {
+        this->buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+/// \brief record one value
+/// \param value the value
+void metrics_histogram::observe(double value) {
+    if (std::isnan(value)) {
+        return;
+    }
+    size_t index = std::lower_bound(this->bounds.begin(), this->bounds.end(), value) - this->bounds.begin();
+    this->buckets[index].fetch_add(1, std::memory_order_relaxed);
+    this->sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+/// \brief append the histogram in the Prometheus text format
+/// \param out the output
+/// \param name the metric name
+/// \param help the help text
+/// \note Buckets are read one by one, a scrape racing with observe() may be off by the in-flight observations
+void metrics_histogram::render(std::string& out, const char* name, const char* help) const {
+    append_header(out, name, help, "histogram");
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= this->bounds.size(); ++i) {
+        cumulative += this->buckets[i].load(std::memory_order_relaxed);
+        out += name;
+        out += "_bucket{le=\"";
+        append_number(out, i < this->bounds.size() ? this->bounds[i] : INFINITY);
+        out += "\"} ";
+        out += std::to_string(cumulative);
+        out += '\n';
+    }
+    out += name;
+    out += "_sum ";
+    append_number(out, this->sum.load(std::memory_order_relaxed));
+    out += '\n';
+    out += name;
+    out += "_count ";
+    // The count is the +Inf bucket, so the two always agree
+    out += std::to_string(cumulative);
+    out += '\n';
+}
+
+/// \brief append the metrics in g_metrics in the Prometheus text format
+/// \param out the output
+void metrics_render(std::string& out) {
+    g_metrics.ttft_seconds.render(out, "flm_ttft_seconds",
+        "Time from request arrival to the first streamed chunk.");
+    g_metrics.inter_token_seconds.render(out, "flm_inter_token_seconds",
+        "Time between consecutive decoded tokens.");
+    g_metrics.prefill_tokens_per_second.render(out, "flm_prefill_tokens_per_second",
+        "Prefill throughput per prompt.");
+    g_metrics.decode_tokens_per_second.render(out, "flm_decode_tokens_per_second",
+        "Decoding throughput per response.");
+    g_metrics.queue_wait_seconds.render(out, "flm_npu_queue_wait_seconds",
+        "Time spent in the NPU admission queue by admitted requests.");
+    g_metrics.model_load_seconds.render(out, "flm_model_load_seconds",
+        "Time to load a model onto the NPU.");
+    metrics_render_counter(out, "flm_requests_total", "HTTP requests received.",
+        g_metrics.requests_total.load(std::memory_order_relaxed));
+    metrics_render_counter(out, "flm_prompt_tokens_total", "Prompt tokens prefilled.",
+        g_metrics.prompt_tokens_total.load(std::memory_order_relaxed));
+    metrics_render_counter(out, "flm_generated_tokens_total", "Tokens generated.",
+        g_metrics.generated_tokens_total.load(std::memory_order_relaxed));
+}
+
+/// \brief append one counter in the Prometheus text format
+/// \param out the output
+/// \param name the metric name
+/// \param help the help text
+/// \param value the value
+void metrics_render_counter(std::string& out, const char* name, const char* help, uint64_t value) {
+    append_header(out, name, help, "counter");
+    out += name;
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+/// \brief append one gauge in the Prometheus text format
+/// \param out the output
+/// \param name the metric name
+/// \param help the help text
+/// \param value the value
+void metrics_render_gauge(std::string& out, const char* name, const char* help, double value) {
+    append_header(out, name, help, "gauge");
+    out += name;
+    out += ' ';
+    append_number(out, value);
+    out += '\n';
+}
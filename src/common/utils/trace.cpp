@@ -0,0 +1,267 @@
+/// \file trace.cpp
+/// \brief scoped trace spans, exported in the Chrome trace event format
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Every thread appends to its own buffer, the buffer lock is only contended while a dump runs
+#include "utils/trace.hpp"
+#include "utils/debug_utils.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> g_trace_enabled{false};
+
+namespace {
+
+/// \brief spans kept per thread before new ones are dropped
+const size_t TRACE_MAX_EVENTS_PER_THREAD = 256 * 1024;
+
+/// \brief one complete span
+typedef struct {
+    const char* name;
+    const char* category;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint64_t request;
+} trace_event_t;
+
+/// \brief spans recorded by one thread
+typedef struct {
+    std::mutex mutex;
+    std::vector<trace_event_t> events;
+    uint32_t tid;
+} trace_thread_buffer_t;
+
+/// \brief registry of the thread buffers
+typedef struct {
+    std::mutex mutex;
+    // Buffers are shared so that spans of exited threads can still be dumped
+    std::vector<std::shared_ptr<trace_thread_buffer_t>> buffers;
+    std::atomic<uint32_t> next_tid{1};
+    std::atomic<uint64_t> next_request{1};
+    std::atomic<uint64_t> dropped{0};
+    std::string dump_dir;
+} trace_state_t;
+
+/// \brief the trace state, constructed on first use
+trace_state_t& trace_state() {
+    static trace_state_t state;
+    return state;
+}
+
+/// \brief the trace epoch
+const std::chrono::steady_clock::time_point g_trace_epoch = std::chrono::steady_clock::now();
+
+/// \brief request current on this thread, 0 if none
+thread_local uint64_t t_trace_request = 0;
+
+/// \brief the buffer of the calling thread, registered on first use
+trace_thread_buffer_t& thread_buffer() {
+    thread_local std::shared_ptr<trace_thread_buffer_t> buffer = []() {
+        trace_state_t& state = trace_state();
+        auto created = std::make_shared<trace_thread_buffer_t>();
+        created->tid = state.next_tid.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.buffers.push_back(created);
+        return created;
+    }();
+    return *buffer;
+}
+
+/// \brief append microseconds with nanosecond precision
+/// \param out the output
+/// \param ns the time in nanoseconds
+void append_us(std::string& out, uint64_t ns) {
+    char text[32];
+    int n = std::snprintf(text, sizeof(text), "%llu.%03llu", (unsigned long long)(ns / 1000), (unsigned long long)(ns % 1000));
+    out.append(text, n > 0 ? static_cast<size_t>(n) : 0);
+}
+
+/// \brief read an environment variable
+/// \param name the name
+/// \return the value, empty if not set
+std::string read_env(const char* name) {
+    std::string value;
+#ifdef _WIN32
+    char* env = nullptr;
+    size_t len = 0;
+    if (_dupenv_s(&env, &len, name) == 0 && env != nullptr) {
+        value = env;
+        free(env);
+    }
+#else
+    const char* env = std::getenv(name);
+    if (env != nullptr) {
+        value = env;
+    }
+#endif
+    return value;
+}
+
+} // namespace
+
+/// \brief enable or disable tracing
+/// \param enabled the switch
+void trace_set_enabled(bool enabled) {
+    g_trace_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+/// \brief read FLM_TRACE and FLM_TRACE_DIR
+void trace_init_from_env() {
+    std::string enabled = read_env("FLM_TRACE");
+    std::string dir = read_env("FLM_TRACE_DIR");
+    if (!dir.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        if (ec) {
+            header_print("WARNING", "Cannot create trace directory " << dir << ": " << ec.message());
+        } else {
+            trace_state().dump_dir = dir;
+        }
+    }
+    if ((!enabled.empty() && enabled != "0") || !trace_state().dump_dir.empty()) {
+        trace_set_enabled(true);
+        header_print("FLM", "Tracing enabled" << (trace_state().dump_dir.empty() ? "" : ", writing one trace per request to " + trace_state().dump_dir));
+    }
+}
+
+/// \brief allocate an id for a request
+/// \return the id
+uint64_t trace_new_request() {
+    return trace_state().next_request.fetch_add(1, std::memory_order_relaxed);
+}
+
+/// \brief the request current on this thread
+/// \return the id, 0 if none
+uint64_t trace_current_request() {
+    return t_trace_request;
+}
+
+/// \brief finish a request, writes its spans to the trace directory if one is set
+/// \param request the request id
+void trace_finish_request(uint64_t request) {
+    trace_state_t& state = trace_state();
+    if (request == 0 || state.dump_dir.empty() || !trace_enabled()) {
+        return;
+    }
+    std::string out;
+    trace_dump(out, request, true);
+    std::filesystem::path path = std::filesystem::path(state.dump_dir) / ("trace_" + std::to_string(request) + ".json");
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        header_print("WARNING", "Cannot write trace file " << path.string());
+        return;
+    }
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+}
+
+/// \brief append the recorded spans as a Chrome trace JSON object
+/// \param out the output
+/// \param request only spans of this request, 0 for all spans
+/// \param clear remove the exported spans
+/// \note Span names and categories are literals from the code and are not escaped
+void trace_dump(std::string& out, uint64_t request, bool clear) {
+    trace_state_t& state = trace_state();
+    std::vector<std::shared_ptr<trace_thread_buffer_t>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        buffers = state.buffers;
+    }
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    std::vector<trace_event_t> events;
+    for (auto& buffer : buffers) {
+        events.clear();
+        {
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            if (request == 0) {
+                events = buffer->events;
+                if (clear) {
+                    buffer->events.clear();
+                }
+            } else {
+                auto keep = buffer->events.begin();
+                for (auto it = buffer->events.begin(); it != buffer->events.end(); ++it) {
+                    if (it->request == request) {
+                        events.push_back(*it);
+                    } else if (clear) {
+                        *keep++ = *it;
+                    }
+                }
+                if (clear) {
+                    buffer->events.erase(keep, buffer->events.end());
+                }
+            }
+        }
+        for (const trace_event_t& event : events) {
+            out += first ? "\n" : ",\n";
+            first = false;
+            out += "{\"name\":\"";
+            out += event.name;
+            out += "\",\"cat\":\"";
+            out += event.category;
+            out += "\",\"ph\":\"X\",\"ts\":";
+            append_us(out, event.start_ns);
+            out += ",\"dur\":";
+            append_us(out, event.duration_ns);
+            out += ",\"pid\":1,\"tid\":";
+            out += std::to_string(buffer->tid);
+            if (event.request != 0) {
+                out += ",\"args\":{\"request\":";
+                out += std::to_string(event.request);
+                out += "}";
+            }
+            out += "}";
+        }
+    }
+    out += "\n]}\n";
+}
+
+/// \brief number of spans dropped because a thread buffer was full
+/// \return the number of dropped spans
+uint64_t trace_dropped_spans() {
+    return trace_state().dropped.load(std::memory_order_relaxed);
+}
+
+/// \brief record a complete span
+/// \param name the span name
+/// \param category the category
+/// \param start_ns the start
+/// \param end_ns the end
+void trace_record(const char* name, const char* category, uint64_t start_ns, uint64_t end_ns) {
+    trace_thread_buffer_t& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.events.size() >= TRACE_MAX_EVENTS_PER_THREAD) {
+        trace_state().dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.events.push_back({name, category, start_ns, end_ns - start_ns, t_trace_request});
+}
+
+/// \brief nanoseconds since the trace epoch
+/// \return the time, never 0 so that 0 can mean "not started"
+uint64_t trace_now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_trace_epoch).count() + 1;
+}
+
+/// \brief make a request current on this thread
+/// \param request the request id
+/// \param finish finish the request when the scope ends
+trace_request_scope::trace_request_scope(uint64_t request, bool finish)
+    : request(request), previous(t_trace_request), finish(finish) {
+    t_trace_request = request;
+}
+
+/// \brief restore the previous request
+trace_request_scope::~trace_request_scope() {
+    t_trace_request = this->previous;
+    if (this->finish) {
+        trace_finish_request(this->request);
+    }
+}
@@ -285,13 +285,17 @@ public:
         if (!file.is_open()) {
             throw std::runtime_error("Failed to open file: " + filename);
         }
-        file.seekg(0, std::ios::end);
-        size_t file_size = file.tellg();
-        file.seekg(0, std::ios::beg);
-        if (size == 0) size = file_size;
-        assert(size <= file_size);
+        if (size == 0) {
+            // Only a whole-file read needs the file size
+            file.seekg(0, std::ios::end);
+            size = file.tellg();
+            file.seekg(0, std::ios::beg);
+        }
         assert(offset + size <= size_);
         file.read(reinterpret_cast<char*>(data_) + offset, size);
+        if ((size_t)file.gcount() != size) {
+            throw std::runtime_error("Short read from " + filename + ": " + std::to_string(file.gcount()) + " of " + std::to_string(size) + " bytes");
+        }
         file.close();
     }
 };
@@ -6,6 +6,7 @@
 /// \note This is a header file for the chat_bot class
 #pragma once
 
+#include <array>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
@@ -14,6 +15,7 @@
 #include <iostream>
 #include <string>
 #include <type_traits>
+#include <functional>
 #include "typedef.hpp"
 #include "causal_lm.hpp"
 #include "lm_config.hpp"
@@ -31,10 +33,14 @@
 
 using json = nlohmann::ordered_json;
 
+/// \brief Polled once per decoded token, returns true if the generation should stop
+typedef std::function<bool()> cancel_check_t;
+
 typedef enum {
     EOT_DETECTED,
     MAX_LENGTH_REACHED,
-    ERROR_DETECTED
+    ERROR_DETECTED,
+    CANCELLED
 } stop_reason_t;
 
 inline std::string stop_reason_to_string(stop_reason_t reason){
@@ -45,6 +51,8 @@ inline std::string stop_reason_to_string(stop_reason_t reason){
             return "length";
         case ERROR_DETECTED:
             return "error";
+        case CANCELLED:
+            return "cancelled";
         default:
             return "UNKNOWN";
     }
@@ -58,6 +66,7 @@ typedef struct {
     uint64_t prefill_duration; // in nanoseconds
     uint64_t decoding_duration; // in nanoseconds
     stop_reason_t stop_reason;
+    int cached_tokens; // prompt tokens served from the KV cache of the previous turn
 } chat_meta_info;
 
 /// \brief chat_bot class
@@ -81,6 +90,7 @@ private:
     int device_id = 0;
     int last_token = -1;
     uint32_t total_tokens = 0;
+    bool context_has_payload = false;
     std::unique_ptr<LM_Config> lm_config = nullptr;
 
     typedef enum{
@@ -93,7 +103,7 @@ private:
         TOTAL_TIME,
         PROFILER_TYPE_NUM
     } profiler_type;
-    std::vector<profiler> profiler_list;
+    std::array<profiler, PROFILER_TYPE_NUM> profiler_list;
 
     time_utils::time_with_unit last_prefill_time;
 
@@ -104,19 +114,31 @@ public:
     /// \brief Clear the context
     void clear_context();
 
+    /// \brief Rewind the context to its first length tokens, keeping their KV cache
+    /// \param length the number of tokens to keep
+    void rewind_context(size_t length);
+
     /// \brief Insert the tokens
     /// \param tokens the tokens
     /// \param is_system_prompt the is system prompt
     /// \return true if the tokens are inserted successfully, false otherwise
     bool insert(chat_meta_info& meta_info, std::vector<int>& tokens, bool is_system_prompt = false, void* payload = nullptr);
 
+    /// \brief Insert a full prompt, reusing the KV cache of the longest common prefix with the current context
+    /// \param tokens the tokens of the whole conversation
+    /// \param payload the payload, e.g. image pixels; a payload disables prefix reuse
+    /// \return true if the tokens are inserted successfully, false otherwise
+    bool insert_with_prefix_cache(chat_meta_info& meta_info, std::vector<int>& tokens, void* payload = nullptr);
+
     /// \brief Generate the tokens
     /// \param os the output stream
+    /// \param is_cancelled polled before every decoding step, generation stops with CANCELLED if it returns true
     /// \return the tokens
-    std::string generate(chat_meta_info& meta_info, int length_limit, std::ostream& os = std::cout);
+    std::string generate(chat_meta_info& meta_info, int length_limit, std::ostream& os = std::cout, cancel_check_t is_cancelled = nullptr);
 
     /// \brief Generate the tokens with prompt
-    std::string generate_with_prompt(chat_meta_info& meta_info, std::vector<int>& tokens, int length_limit, std::ostream& os = std::cout, void* payload = nullptr);
+    /// \note The prompt is the whole conversation, only the suffix not in the KV cache is prefilled
+    std::string generate_with_prompt(chat_meta_info& meta_info, std::vector<int>& tokens, int length_limit, std::ostream& os = std::cout, void* payload = nullptr, cancel_check_t is_cancelled = nullptr);
 
     /// \brief Get the current context length
     /// \return the current context length
@@ -210,6 +232,24 @@ public:
     /// \param frequency_penalty_window the frequency penalty window
     void set_frequency_penalty_window(int frequency_penalty_window);
 
+    /// \brief Set the min-p
+    /// \param min_p the min-p, 0 disables it
+    void set_min_p(float min_p);
+
+    /// \brief Set the typical-p
+    /// \param typical_p the typical-p, 1 disables it
+    void set_typical_p(float typical_p);
+
+    /// \brief Set mirostat
+    /// \param mirostat the version, 0 disables it
+    /// \param tau the target surprise
+    /// \param eta the learning rate
+    void set_mirostat(int mirostat, float tau = 5.0f, float eta = 0.1f);
+
+    /// \brief Set the sampling seed
+    /// \param seed the seed, negative for a random seed
+    void set_seed(int64_t seed);
+
     /// \brief Start the ttft timer
     /// \return the ttft timer
     void start_ttft_timer();
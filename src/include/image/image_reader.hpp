@@ -7,6 +7,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 #include "typedef.hpp"
@@ -17,7 +18,8 @@
 // Load image from file and resize to 896x896 RGB24 format
 bytes load_image(const std::string& filename);
 
-bytes load_image_base64(const std::string& base64_string);
+// Load image from base64 encoded data, decoded without an intermediate string
+bytes load_image_base64(std::string_view base64_string);
 
 // Save RGB24 image as PPM file
 bool save_image(const std::string& filename, const bytes& image);
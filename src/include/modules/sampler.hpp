@@ -7,7 +7,9 @@
 #pragma once
 
 #include "typedef.hpp"
+#include <cstdint>
 #include <deque>
+#include <vector>
 
 /// \brief sampler config
 /// \param temperature the temperature
@@ -16,6 +18,12 @@
 /// \param rep_penalty the rep penalty
 /// \param freq_penalty the freq penalty
 /// \param rep_penalty_window the rep penalty window
+/// \param seed the PRNG seed, negative for a random seed
+/// \param min_p the min p, relative to the most likely token, 0 disables it
+/// \param typical_p the typical p, 1 disables it
+/// \param mirostat the mirostat version, 0 disables it, 1 or 2
+/// \param mirostat_tau the mirostat target surprise
+/// \param mirostat_eta the mirostat learning rate
 typedef struct sampler_config_{
     float temperature = 1.0f;
     int top_k = 5;
@@ -24,8 +32,75 @@ typedef struct sampler_config_{
     float freq_penalty = 1.0f;
     int rep_penalty_window = 1024;
     int freq_penalty_window = 1024;  // Window size for frequency penalty
+    int64_t seed = -1;
+    float min_p = 0.0f;
+    float typical_p = 1.0f;
+    int mirostat = 0;
+    float mirostat_tau = 5.0f;
+    float mirostat_eta = 0.1f;
 } sampler_config;
 
+/// \brief xoshiro256** PRNG, seeded through splitmix64
+/// \note Each sampler owns one, so requests neither share state nor lock
+class sampler_rng{
+public:
+    sampler_rng(){ this->seed(0); }
+
+    /// \brief Seed the generator
+    /// \param seed the seed, the same seed gives the same sequence
+    void seed(uint64_t seed){
+        for (int i = 0; i < 4; i++){
+            seed += 0x9E3779B97F4A7C15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            this->s[i] = z ^ (z >> 31);
+        }
+    }
+
+    /// \brief Next 64 random bits
+    uint64_t next(){
+        uint64_t result = rotl(this->s[1] * 5, 7) * 9;
+        uint64_t t = this->s[1] << 17;
+        this->s[2] ^= this->s[0];
+        this->s[3] ^= this->s[1];
+        this->s[1] ^= this->s[2];
+        this->s[0] ^= this->s[3];
+        this->s[2] ^= t;
+        this->s[3] = rotl(this->s[3], 45);
+        return result;
+    }
+
+    /// \brief Uniform float in [0, 1)
+    float next_float(){
+        // The upper 24 bits fill the float mantissa exactly
+        return (float)(this->next() >> 40) * (1.0f / 16777216.0f);
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k){
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t s[4];
+};
+
+/// \brief sampling variant, picked from the config so that unneeded passes are compiled out
+typedef enum {
+    SAMPLER_MODE_GREEDY,     // argmax, temperature <= 0 or top_k <= 1
+    SAMPLER_MODE_TOP_K,      // temperature over the top-k, top_p >= 1
+    SAMPLER_MODE_TOP_K_TOP_P,// temperature over the top-k, then the top-p cutoff
+    SAMPLER_MODE_CHAIN       // temperature over the top-k, then the stages of the chain
+} sampler_mode_t;
+
+/// \brief stage of the sampler chain, every stage works on the top-k candidates only
+typedef enum {
+    SAMPLER_STAGE_TOP_P,     // keep the smallest prefix holding top_p of the mass
+    SAMPLER_STAGE_MIN_P,     // drop candidates below min_p times the most likely one
+    SAMPLER_STAGE_TYPICAL_P, // keep the candidates closest to the entropy, up to typical_p of the mass
+    SAMPLER_STAGE_MIROSTAT   // truncate to hold the surprise at mirostat_tau, must be the last stage
+} sampler_stage_t;
+
 typedef std::pair<float, int> logits_t;
 typedef std::vector<logits_t> logits_list_t;
 
@@ -40,6 +115,12 @@ public:
     float temperature;
     int top_k;
     float top_p;
+    float min_p;
+    float typical_p;
+    int mirostat;
+    float mirostat_tau;
+    float mirostat_eta;
+    float mirostat_mu;
     int total_tokens;
     std::vector<int> token_positions;
     
@@ -49,6 +130,20 @@ public:
     float freq_penalty_decay;
     size_t rep_penalty_window;
 
+    // Sparse set of the tokens that may still be penalized, so penalties never scan the vocabulary
+    std::vector<int> active_tokens;
+    std::vector<u8> is_active;
+
+    // Per-sampler PRNG, see set_seed()
+    sampler_rng rng;
+
+    // Variant used by sample(), see update_mode()
+    sampler_mode_t mode = SAMPLER_MODE_GREEDY;
+
+    // Stages run by SAMPLER_MODE_CHAIN, in order, see update_mode()
+    std::vector<sampler_stage_t> chain;
+    logits_list_t chain_scratch;
+
     /// \brief Constructor
     /// \param in_features the input features
     /// \param config the configuration
@@ -63,8 +158,49 @@ public:
     /// \note The function will reset the token positions
     void reset_penalties();
 
+    /// \brief Seed the PRNG
+    /// \param seed the seed, negative for a random seed
+    /// \note With a fixed seed and the same prompt and parameters, the output is reproducible
+    void set_seed(int64_t seed);
+
+    /// \brief Pick the sampling variant for the current parameters
+    /// \note Call it after changing temperature, top_k, top_p, min_p, typical_p or mirostat
+    /// \note The chain is top-p, min-p, typical-p, mirostat replaces them all
+    void update_mode();
+
+    /// \brief Replace the stages of the chain
+    /// \param stages the stages, in order
+    /// \note Kept until the next update_mode()
+    void set_chain(const std::vector<sampler_stage_t>& stages);
+
     /// \brief Sample the token
     /// \param x the input buffer
     /// \return the sampled token
     int sample(buffer<bf16>& x);
+
+private:
+    /// \brief Sample the token with one variant
+    /// \param x the input buffer
+    /// \return the sampled token
+    template<sampler_mode_t MODE>
+    int sample_mode(buffer<bf16>& x);
+
+    /// \brief Apply the repetition and frequency penalties to the active tokens
+    /// \param x the bf16 logits
+    /// \note Tokens out of the repetition window and the frequency window are dropped from the set
+    void apply_penalties(const bf16* x);
+
+    /// \brief Record a sampled token in the penalty state
+    /// \param token the token
+    void update_penalties(int token);
+
+    /// \brief Run the chain on the weighted candidates and draw one
+    /// \param count the number of candidates in top_k_logits
+    /// \return the sampled token
+    int sample_chain(int count);
+
+    /// \brief Mirostat stage, draws the token and updates mirostat_mu
+    /// \param count the number of candidates in top_k_logits
+    /// \return the sampled token
+    int sample_mirostat(int count);
 };
\ No newline at end of file
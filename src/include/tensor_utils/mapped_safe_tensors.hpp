@@ -0,0 +1,69 @@
+/// \file mapped_safe_tensors.hpp
+/// \brief MappedSafeTensors class
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note This class is used to read tensors from a memory-mapped safe-tensors file without copies, it backs ShardedSafeTensors.
+#pragma once
+
+#include "typedef.hpp"
+#include "nlohmann/json.hpp"
+#include "tensor_utils/safe_tensors.hpp"
+#include "utils/mapped_file.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// \brief read-only view of one tensor in the mapping
+/// \param meta the tensor metadata, offsets are relative to the data section
+/// \param data the first byte of the tensor in the mapping
+typedef struct {
+    tensor_metadata meta;
+    const uint8_t* data;
+} tensor_view;
+
+/// \brief MappedSafeTensors class
+/// \note Tensors are views into the page cache, they stay valid while the object lives.
+/// \note The mapping is read-only, writing through a view crashes.
+class MappedSafeTensors{
+private:
+    std::string file_path;
+    mapped_file file;
+    nlohmann::json metadata;
+    std::vector<tensor_view> tensors;
+    std::unordered_map<std::string, size_t> tensor_index;
+    void _parse_header();
+
+public:
+    /// \brief Constructor
+    /// \param file_path the safe-tensors file, e.g. model_path + "/model.q4nx"
+    /// \note Throws std::runtime_error if the file cannot be mapped or its header is invalid
+    MappedSafeTensors(const std::string& file_path);
+
+    /// \brief Check if a tensor exists
+    /// \param tensor_name the tensor name
+    /// \return true if the tensor exists
+    bool contains(const std::string& tensor_name) const;
+
+    /// \brief Get a tensor
+    /// \param tensor_name the tensor name
+    /// \return the view, throws std::out_of_range if the tensor does not exist
+    const tensor_view& get_tensor(const std::string& tensor_name) const;
+
+    /// \brief Get all the tensors, in file order
+    /// \return the views
+    const std::vector<tensor_view>& get_tensors() const { return this->tensors; }
+
+    /// \brief Get the metadata
+    /// \return the __metadata__ entry of the header, empty if there is none
+    nlohmann::json get_metadata() const;
+
+    /// \brief Hint the access pattern of the whole file
+    /// \param advice the hint
+    void advise(mapped_advice_t advice) const;
+
+    /// \brief Hint the access pattern of one tensor
+    /// \param tensor_name the tensor name
+    /// \param advice the hint
+    void advise(const std::string& tensor_name, mapped_advice_t advice) const;
+};
@@ -0,0 +1,66 @@
+/// \file model_converter.hpp
+/// \brief ModelConverter class
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note This class is used to quantize a single-file or sharded checkpoint on several threads, streaming the output.
+#pragma once
+
+#include "typedef.hpp"
+#include "tensor_utils/sharded_safe_tensors.hpp"
+#include <string>
+
+/// \brief options of a conversion
+/// \param threads the number of worker threads, 0 for one per core
+/// \param chunk_values the values per work item, bounds the memory of a worker
+typedef struct {
+    int threads = 0;
+    size_t chunk_values = 1024 * 1024;
+} model_convert_options_t;
+
+/// \brief throughput of a conversion
+/// \param tensors the tensors read
+/// \param quantized the tensors quantized to int4
+/// \param input_bytes the bytes read
+/// \param output_bytes the bytes written
+/// \param wall_seconds the wall time of the conversion
+typedef struct {
+    size_t tensors;
+    size_t quantized;
+    uint64_t input_bytes;
+    uint64_t output_bytes;
+    double wall_seconds;
+} model_convert_stats_t;
+
+/// \brief ModelConverter class
+/// \note Linear weights become <name>.qweight (U32, 8 nibbles per word), <name>.scales (BF16) and <name>.qzeros (I32),
+///       in the layout of q4nx_dequantize_bf16. Other float tensors become BF16, anything else is copied.
+/// \note The output is not a model.q4nx, the weights are not reordered for the NPU and the engines cannot load it.
+/// \note The work items are row ranges, so a large tensor is spread over the workers too.
+/// \note A worker holds one row range at a time, the input is mapped and the output goes through SafeTensorsWriter.
+class ModelConverter{
+private:
+    const ShardedSafeTensors& input;
+    model_convert_options_t options;
+
+public:
+    /// \brief Constructor
+    /// \param input the checkpoint
+    /// \param options the options
+    ModelConverter(const ShardedSafeTensors& input, const model_convert_options_t& options = model_convert_options_t());
+
+    /// \brief Check if a tensor is quantized
+    /// \param meta the tensor metadata
+    /// \return true for 2-D float weights whose rows split into groups of Q4NX_GROUP_SIZE, except embeddings and norms
+    static bool is_quantizable(const tensor_metadata& meta);
+
+    /// \brief Convert the checkpoint
+    /// \param output_path the output safe-tensors file
+    /// \return the throughput
+    /// \note Throws std::runtime_error on an I/O error, a partial output is removed
+    model_convert_stats_t convert(const std::string& output_path);
+
+    /// \brief Print the throughput of a conversion
+    /// \param stats the throughput
+    static void print_stats(const model_convert_stats_t& stats);
+};
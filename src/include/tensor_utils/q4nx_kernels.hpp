@@ -0,0 +1,66 @@
+/// \file q4nx_kernels.hpp
+/// \brief host-side Q4NX dequantization kernels
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Scalar, AVX2 and AVX-512 variants, the best one the CPU supports is picked at runtime.
+/// \note All variants give bit-identical results, (q - zero_point) * scale is exact in fp32 and rounded to bf16 once.
+/// \note The layout is the one Q4NX::q4nx_dequantize reads: row-major, 8 values per word with value i in bits 4i..4i+3,
+///       and one scale and one zero point per group of Q4NX_GROUP_SIZE consecutive values of a row.
+#pragma once
+
+#include "typedef.hpp"
+#include "buffer.hpp"
+
+/// \brief values per scale and zero point, fixed by Q4NX
+const size_t Q4NX_GROUP_SIZE = 32;
+
+/// \brief instruction set of a dequantization kernel
+typedef enum {
+    Q4NX_ISA_SCALAR = 0,
+    Q4NX_ISA_AVX2 = 1,
+    Q4NX_ISA_AVX512 = 2
+} q4nx_isa_t;
+
+/// \brief the best instruction set the CPU and the OS support, detected once
+/// \return the instruction set
+q4nx_isa_t q4nx_detect_isa();
+
+/// \brief check if the CPU and the OS support an instruction set
+/// \param isa the instruction set
+/// \return true if the kernel can run
+bool q4nx_isa_supported(q4nx_isa_t isa);
+
+/// \brief name of an instruction set
+/// \param isa the instruction set
+/// \return "scalar", "avx2" or "avx512"
+const char* q4nx_isa_name(q4nx_isa_t isa);
+
+/// \brief Dequantize int4 weights to bf16
+/// \param weight the output, count values
+/// \param q the packed weights, count / 8 words
+/// \param scale the scales, count / Q4NX_GROUP_SIZE
+/// \param zero_point the zero points, count / Q4NX_GROUP_SIZE
+/// \param count the number of values, a multiple of Q4NX_GROUP_SIZE
+/// \param threads the number of threads, 0 for one per core, small tensors always use one
+/// \param isa the kernel, Q4NX_ISA_AVX512 and Q4NX_ISA_AVX2 fall back to what the CPU supports
+void q4nx_dequantize_bf16(bf16* weight, const u32* q, const bf16* scale, const i32* zero_point, size_t count, int threads = 0, q4nx_isa_t isa = Q4NX_ISA_AVX512);
+
+/// \brief Dequantize int4 weights to bf16, a drop-in for Q4NX::q4nx_dequantize<bf16>
+/// \param weight the output, scale.size() * Q4NX_GROUP_SIZE values, sets the size
+/// \param q the packed weights, row-major
+/// \param scale the scales, rows x (columns / Q4NX_GROUP_SIZE)
+/// \param zero_point the zero points, rows x (columns / Q4NX_GROUP_SIZE)
+/// \param columns the columns, a multiple of Q4NX_GROUP_SIZE
+/// \param threads the number of threads, 0 for one per core
+/// \note Throws std::invalid_argument if the buffer sizes do not match
+void q4nx_dequantize_bf16(buffer<bf16>& weight, buffer<u32>& q, buffer<bf16>& scale, buffer<i32>& zero_point, const int columns, int threads = 0);
+
+/// \brief Quantize fp32 weights to int4, the inverse of q4nx_dequantize_bf16
+/// \param weight the input, count values
+/// \param q the packed weights, count / 8 words
+/// \param scale the scales, one per group, (max - min) / 15 rounded to bf16
+/// \param zero_point the zero points, one per group, 0 to 15
+/// \param count the number of values, a multiple of Q4NX_GROUP_SIZE
+/// \note Asymmetric min-max quantization, the bf16 scale is used for rounding so dequantization sees the same grid
+void q4nx_quantize(const float* weight, u32* q, bf16* scale, i32* zero_point, size_t count);
@@ -0,0 +1,69 @@
+/// \file safe_tensors_writer.hpp
+/// \brief SafeTensorsWriter class
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note This class is used by ModelConverter to stream tensors into a safe-tensors file without holding them in memory.
+#pragma once
+
+#include "typedef.hpp"
+#include "nlohmann/json.hpp"
+#include "tensor_utils/safe_tensors.hpp"
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// \brief SafeTensorsWriter class
+/// \note The layout is fixed up front, so the header is written first and tensors can arrive in any order from any thread.
+/// \note The file is written next to its final path and renamed by commit(), an unfinished file never replaces a good one.
+class SafeTensorsWriter{
+private:
+    std::string file_path;
+    std::string temp_path;
+    std::ofstream file;
+    std::mutex mutex;
+    std::vector<tensor_metadata> tensors_data;
+    std::unordered_map<std::string, size_t> tensor_index;
+    std::vector<std::map<size_t, size_t>> covered;
+    size_t data_start;
+    size_t data_size;
+    size_t written;
+    bool committed;
+
+    /// \brief Record a written byte range of a tensor, the caller holds the mutex
+    void mark_covered(size_t index, size_t begin, size_t end);
+
+public:
+    /// \brief Constructor
+    /// \param file_path the output file
+    /// \param tensors the tensors, name, dtype, shape and byte_size are used, offsets are assigned in order
+    /// \param metadata the __metadata__ entry, string values only, empty for none
+    /// \note Throws std::runtime_error if the file cannot be created
+    SafeTensorsWriter(const std::string& file_path, const std::vector<tensor_metadata>& tensors, const nlohmann::json& metadata = nlohmann::json::object());
+
+    /// \brief Destructor, removes the file if it was not committed
+    ~SafeTensorsWriter();
+
+    SafeTensorsWriter(const SafeTensorsWriter&) = delete;
+    SafeTensorsWriter& operator=(const SafeTensorsWriter&) = delete;
+
+    /// \brief Write a tensor or a part of it, safe to call from any thread
+    /// \param tensor_name the tensor name
+    /// \param data the bytes
+    /// \param size the number of bytes
+    /// \param offset the offset in the tensor
+    void write(const std::string& tensor_name, const void* data, size_t size, size_t offset = 0);
+
+    /// \brief Finish the file and move it to its final path
+    /// \note Throws std::runtime_error if any byte of any tensor was never written or the file cannot be renamed
+    void commit();
+
+    /// \brief Distinct tensor bytes written so far, overlapping writes count once
+    size_t bytes_written() const { return this->written; }
+
+    /// \brief Bytes of tensor data in the layout
+    size_t total_bytes() const { return this->data_size; }
+};
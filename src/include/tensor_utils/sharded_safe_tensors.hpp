@@ -0,0 +1,80 @@
+/// \file sharded_safe_tensors.hpp
+/// \brief ShardedSafeTensors class
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note This class is used to read a checkpoint split over model-0000x-of-0000y.safetensors shards.
+#pragma once
+
+#include "typedef.hpp"
+#include "nlohmann/json.hpp"
+#include "tensor_utils/mapped_safe_tensors.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// \brief name of the shard index in a model directory
+#define SAFETENSORS_INDEX_FILE "model.safetensors.index.json"
+
+/// \brief ShardedSafeTensors class
+/// \note Every shard is memory-mapped, a tensor is a view into the shard that holds it.
+/// \note A single-file checkpoint is read as one shard, so callers need not care which one they got.
+class ShardedSafeTensors{
+private:
+    std::string path;
+    std::vector<std::unique_ptr<MappedSafeTensors>> shards;
+    std::vector<std::string> shard_files;
+    std::unordered_map<std::string, size_t> tensor_shard;
+    std::vector<std::string> tensor_names;
+    nlohmann::json metadata;
+    void _open_index(const std::string& index_path);
+    void _open_single(const std::string& file_path);
+
+public:
+    /// \brief Constructor
+    /// \param path a model directory, an index file or a single safe-tensors file
+    /// \note A directory is read through model.safetensors.index.json if it exists, model.safetensors otherwise
+    /// \note Throws std::runtime_error if a shard is missing or a tensor is listed in the index but not in its shard
+    ShardedSafeTensors(const std::string& path);
+
+    /// \brief Check if a tensor exists
+    /// \param tensor_name the tensor name
+    /// \return true if the tensor exists
+    bool contains(const std::string& tensor_name) const;
+
+    /// \brief Get a tensor
+    /// \param tensor_name the tensor name
+    /// \return the view, throws std::out_of_range if the tensor does not exist
+    const tensor_view& get_tensor(const std::string& tensor_name) const;
+
+    /// \brief Get the tensor names, sorted
+    const std::vector<std::string>& get_tensor_names() const { return this->tensor_names; }
+
+    /// \brief Get the metadata
+    /// \return the metadata of the index, or the __metadata__ of a single file
+    nlohmann::json get_metadata() const { return this->metadata; }
+
+    /// \brief Get the number of shards
+    size_t shard_count() const { return this->shards.size(); }
+
+    /// \brief Get a shard
+    /// \param index the shard index
+    const MappedSafeTensors& get_shard(size_t index) const { return *this->shards[index]; }
+
+    /// \brief Get the file name of a shard
+    /// \param index the shard index
+    const std::string& get_shard_file(size_t index) const { return this->shard_files[index]; }
+
+    /// \brief Hint the access pattern of every shard
+    /// \param advice the hint
+    void advise(mapped_advice_t advice) const;
+
+    /// \brief Hint the access pattern of one tensor
+    /// \param tensor_name the tensor name
+    /// \param advice the hint
+    void advise(const std::string& tensor_name, mapped_advice_t advice) const;
+
+    /// \brief Bytes of tensor data over all shards
+    size_t total_bytes() const;
+};
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <memory>
@@ -15,6 +16,9 @@
 #include "minja/chat-template.hpp"
 #include "typedef.hpp"
 
+/// \brief name of the compiled tokenizer cache in the model directory
+#define TOKENIZER_CACHE_FILE "tokenizer.flmcache"
+
 /// \brief Token struct
 /// \param text the text
 /// \param token_id the token id
@@ -40,6 +44,18 @@ typedef enum{
 /// \param token_id the token id
 typedef std::pair<std::string, std::string> TokenPair;
 
+/// \brief Tokens of the last prompt, reused by Tokenizer::encode_prompt
+/// \param text the last prompt
+/// \param tokens the tokens of the last prompt
+/// \param cuts (text offset, token count) right after each end-of-turn token, where encoding can restart
+/// \param verified 0 if no reuse was checked yet, 1 if a reuse matched a full encode, -1 if reuse is disabled
+typedef struct {
+    std::string text;
+    std::vector<int> tokens;
+    std::vector<std::pair<size_t, size_t>> cuts;
+    int verified;
+} prompt_cache_t;
+
 /// \brief Tokenizer class
 class Tokenizer {
 public:
@@ -56,6 +72,16 @@ public:
     /// \return the encoded tokens
     std::vector<int> encode(const std::string& text);
 
+    /// \brief Encode a rendered prompt, reusing the tokens it shares with the previous one
+    /// \param text the rendered prompt
+    /// \return the encoded tokens, identical to encode(text)
+    /// \note Encoding restarts after the last end-of-turn token shared with the previous prompt,
+    ///       special tokens split the pre-tokenizer so the tokens before it cannot change
+    std::vector<int> encode_prompt(const std::string& text);
+
+    /// \brief Drop the tokens kept by encode_prompt
+    void clear_prompt_cache();
+
     /// \brief Decode the tokens
     /// \param tokens the tokens
     /// \return the decoded text
@@ -66,6 +92,12 @@ public:
     /// \return the decoded text
     std::string run_time_decoder(int answer_token);
 
+    /// \brief Run time decoder without allocation
+    /// \param answer_token the answer token
+    /// \return the decoded bytes, valid until the tokenizer is destroyed
+    /// \note Ids outside the table are decoded into a scratch string, valid until the next call
+    std::string_view run_time_decoder_view(int answer_token);
+
     /// \brief Check if the token is EOS
     /// \param token the token
     /// \return true if the token is EOS, false otherwise
@@ -124,6 +156,34 @@ private:
     nlohmann::json extra_context;
     bool is_doubled_encoded;
 
+    // Decoded bytes of every vocabulary entry, token i is token_table[token_table_offsets[i], token_table_offsets[i + 1])
+    // The table views token_bytes and token_offsets, which are filled from the cache or built from the vocabulary
+    std::string_view token_table;
+    const uint32_t* token_table_offsets = nullptr;
+    size_t token_table_size = 0;
+    std::string token_bytes;
+    std::vector<uint32_t> token_offsets;
+    std::string token_scratch;
+
+    prompt_cache_t prompt_cache;
+
+    /// \brief Find the restart points of the cached prompt
+    void update_prompt_cuts();
+
+    /// \brief Decode every vocabulary entry into token_bytes
+    void build_token_table();
+
+    /// \brief Load the tokenizer cache
+    /// \param model_path the model path
+    /// \param chat_template the chat template source
+    /// \return false if the cache is missing, stale or corrupt
+    bool load_cache(const std::string& model_path, std::string& chat_template);
+
+    /// \brief Write the tokenizer cache
+    /// \param model_path the model path
+    /// \param chat_template the chat template source
+    void save_cache(const std::string& model_path, const std::string& chat_template);
+
     /// \brief Convert the cp1252 to utf8
     /// \param input the input string
     /// \return the utf8 string
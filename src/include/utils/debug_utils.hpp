@@ -7,7 +7,9 @@
 #pragma once
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <string>
+#include "logger.hpp"
 
 #ifndef VERBOSE
 #define VERBOSE 0
@@ -17,7 +19,12 @@
 /// \param level the level of the log
 /// \param msg the message to log
 #if VERBOSE >= 1
-    #define LOG_VERBOSE(level, msg) if (level <= VERBOSE) { std::cout << "[log" << level <<"] " << msg << std::endl; }
+    #define LOG_VERBOSE(level, msg) \
+        if ((level <= VERBOSE) && log_enabled(LOG_LEVEL_DEBUG)) { \
+            std::ostringstream oss; \
+            oss << "[log" << level << "] " << msg; \
+            log_line(LOG_LEVEL_DEBUG, oss.str()); \
+        }
 #else
     #define LOG_VERBOSE(level, msg) ((void)0) // No-op
 #endif
@@ -28,7 +35,7 @@
 /// \param msg the message to log
 #if VERBOSE >= 1
     #define LOG_VERBOSE_IF(level, condition, msg) \
-        if ((level <= VERBOSE) && (condition)) { std::cout << "[log" << level << "] " << msg << std::endl; }
+        if ((level <= VERBOSE) && (condition)) { LOG_VERBOSE(level, msg); }
 #else
     #define LOG_VERBOSE_IF(level, condition, msg) ((void)0) // No-op
 #endif
@@ -40,8 +47,8 @@
 /// \param msg_false the message to log if the condition is false
 #if VERBOSE >= 1
     #define LOG_VERBOSE_IF_ELSE(level, condition, msg_true, msg_false) \
-        if ((level <= VERBOSE) && (condition)) { std::cout << "[log" << level << "] " << msg_true << std::endl; } \
-        else if ((level <= VERBOSE)) { std::cout << "[log" << level << "] " << msg_false << std::endl; }
+        if ((level <= VERBOSE) && (condition)) { LOG_VERBOSE(level, msg_true); } \
+        else if ((level <= VERBOSE)) { LOG_VERBOSE(level, msg_false); }
 #else
     #define LOG_VERBOSE_IF_ELSE(level, condition, msg_true, msg_false) ((void)0) // No-op
 #endif
@@ -88,12 +95,7 @@
 /// \brief HEADER_PRINT macro
 /// \param header the header of the message
 /// \param msg the message to log
-#define HEADER_PRINT(header, msg) \
-    do { \
-        std::ostringstream oss; \
-        oss << msg; \
-        std::cout << '[' << header << "]  " << oss.str() << std::endl; \
-    } while (0)
+#define HEADER_PRINT(header, msg) header_print(header, msg)
 
 /// \brief OSTREAM2STRING macro
 /// \param os the ostream to convert
@@ -104,16 +106,29 @@
         return oss.str(); \
     } while (0)
 
-/// \brief header_print macro
+/// \brief header_print_level macro
+/// \param level the log level, the message is not formatted when the level is disabled
 /// \param header the header of the message
 /// \param msg the message to log
-#define header_print(header, msg) \
+#define header_print_level(level, header, msg) \
     do { \
-        std::ostringstream oss; \
-        oss << msg; \
-        std::cout << '[' << header << "]  " << oss.str() << std::endl; \
+        if (log_enabled(level)) { \
+            std::ostringstream oss; \
+            oss << '[' << header << "]  " << msg; \
+            log_line(level, oss.str()); \
+        } \
     } while (0)
 
+/// \brief header_print macro, logged at the level of its tag, see log_level_of_header
+/// \param header the header of the message
+/// \param msg the message to log
+#define header_print(header, msg) header_print_level(log_level_of_header(header), header, msg)
+
+/// \brief header_print_debug macro, for per-connection and other chatty messages
+/// \param header the header of the message
+/// \param msg the message to log
+#define header_print_debug(header, msg) header_print_level(LOG_LEVEL_DEBUG, header, msg)
+
 /// \brief box_print macro
 /// \param msg the message to log
 /// \param width the width of the box
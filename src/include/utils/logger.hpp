@@ -0,0 +1,79 @@
+/// \file logger.hpp
+/// \brief leveled asynchronous logger
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Log lines go through a lock-free ring buffer that a background thread flushes to stdout.
+/// \note Until start_async() is called, lines are written synchronously, so the CLI output keeps its order.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/// \brief log level, lower is more important
+typedef enum {
+    LOG_LEVEL_ERROR = 0,
+    LOG_LEVEL_WARN = 1,
+    LOG_LEVEL_INFO = 2,
+    LOG_LEVEL_DEBUG = 3,
+    LOG_LEVEL_TRACE = 4
+} log_level_t;
+
+/// \brief current verbosity, lines above this level are discarded before they are formatted
+extern std::atomic<int> g_log_level;
+
+/// \brief check if a level is enabled
+/// \param level the level
+/// \return true if lines of this level are logged
+inline bool log_enabled(log_level_t level) {
+    return static_cast<int>(level) <= g_log_level.load(std::memory_order_relaxed);
+}
+
+/// \brief level of a header_print tag, "ERROR" and "WARNING" keep their severity, every other tag is info
+/// \param header the tag
+/// \return the level
+inline log_level_t log_level_of_header(std::string_view header) {
+    if (header == "ERROR" || header == "err ") {
+        return LOG_LEVEL_ERROR;
+    }
+    if (header == "WARNING" || header == "WARN") {
+        return LOG_LEVEL_WARN;
+    }
+    return LOG_LEVEL_INFO;
+}
+
+/// \brief log one line, a newline is appended
+/// \param level the level
+/// \param line the line
+/// \note Never blocks in async mode, lines are dropped and counted when the ring buffer is full
+void log_line(log_level_t level, std::string_view line);
+
+/// \brief set the verbosity
+/// \param level the level
+void log_set_level(log_level_t level);
+
+/// \brief parse a level name, "error", "warn", "info", "debug", "trace" or 0-4
+/// \param name the name
+/// \param level the parsed level
+/// \return true if the name is valid
+bool log_parse_level(const std::string& name, log_level_t& level);
+
+/// \brief level name
+/// \param level the level
+/// \return the name
+const char* log_level_name(log_level_t level);
+
+/// \brief read the verbosity from the FLM_LOG_LEVEL environment variable, if set
+void log_init_from_env();
+
+/// \brief switch to asynchronous logging with a background flusher
+void log_start_async();
+
+/// \brief stop the background flusher, remaining lines are written first
+void log_stop_async();
+
+/// \brief number of lines dropped because the ring buffer was full
+/// \return the number of dropped lines
+uint64_t log_dropped_lines();
@@ -0,0 +1,63 @@
+/// \file mapped_file.hpp
+/// \brief read-only memory-mapped files
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Pages are loaded by the OS on first touch, an unused part of a file costs no I/O.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// \brief access pattern hint for a mapped range
+typedef enum {
+    MAPPED_ADVICE_NORMAL,
+    MAPPED_ADVICE_SEQUENTIAL, // read ahead aggressively, drop pages behind
+    MAPPED_ADVICE_RANDOM,     // no read ahead
+    MAPPED_ADVICE_WILLNEED,   // start reading the range in the background
+    MAPPED_ADVICE_DONTNEED    // the range will not be read again soon
+} mapped_advice_t;
+
+/// \brief a file mapped read-only into memory
+class mapped_file {
+public:
+    mapped_file() = default;
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+
+    /// \brief map a file, the previous mapping is closed
+    /// \param path the path
+    /// \return true on success, an empty file cannot be mapped
+    bool open(const std::string& path);
+
+    /// \brief unmap the file
+    void close();
+
+    /// \brief check if a file is mapped
+    bool is_open() const { return this->base != nullptr; }
+
+    /// \brief start of the mapping
+    const uint8_t* data() const { return this->base; }
+
+    /// \brief size of the mapping in bytes
+    size_t size() const { return this->length; }
+
+    /// \brief hint the access pattern of a range, a no-op where the OS has no equivalent
+    /// \param advice the hint
+    /// \param offset the start of the range
+    /// \param length the length of the range, 0 for the rest of the file
+    void advise(mapped_advice_t advice, size_t offset = 0, size_t length = 0) const;
+
+private:
+    const uint8_t* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
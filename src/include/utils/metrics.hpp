@@ -0,0 +1,75 @@
+/// \file metrics.hpp
+/// \brief Prometheus-style serving metrics
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Histograms have fixed bucket bounds and atomic counters, observe() never locks.
+/// \note Percentiles are computed by the scraper, e.g. histogram_quantile(0.99, rate(flm_ttft_seconds_bucket[5m])).
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// \brief histogram with fixed, cumulative-on-export buckets
+class metrics_histogram {
+public:
+    /// \brief constructor
+    /// \param bounds the upper bounds of the buckets, ascending, +Inf is implicit
+    metrics_histogram(std::initializer_list<double> bounds);
+
+    /// \brief record one value
+    /// \param value the value
+    void observe(double value);
+
+    /// \brief append the histogram in the Prometheus text format
+    /// \param out the output
+    /// \param name the metric name
+    /// \param help the help text
+    void render(std::string& out, const char* name, const char* help) const;
+
+private:
+    /// \brief upper bounds of the buckets
+    std::vector<double> bounds;
+    /// \brief per-bucket counts, the last one is +Inf
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+    /// \brief sum of the observations
+    std::atomic<double> sum;
+};
+
+/// \brief the serving metrics
+typedef struct flm_metrics_t {
+    metrics_histogram ttft_seconds{0.05, 0.1, 0.25, 0.5, 1, 2, 5, 10, 30, 60};
+    metrics_histogram inter_token_seconds{0.005, 0.01, 0.02, 0.03, 0.05, 0.075, 0.1, 0.2, 0.5, 1};
+    metrics_histogram prefill_tokens_per_second{50, 100, 250, 500, 1000, 2000, 4000, 8000};
+    metrics_histogram decode_tokens_per_second{5, 10, 15, 20, 30, 40, 60, 80, 120};
+    metrics_histogram queue_wait_seconds{0.001, 0.01, 0.1, 0.5, 1, 5, 10, 30, 60, 300};
+    metrics_histogram model_load_seconds{0.5, 1, 2, 5, 10, 20, 30, 60, 120};
+    std::atomic<uint64_t> requests_total{0};
+    std::atomic<uint64_t> prompt_tokens_total{0};
+    std::atomic<uint64_t> generated_tokens_total{0};
+} flm_metrics_t;
+
+/// \brief the process-wide metrics
+extern flm_metrics_t g_metrics;
+
+/// \brief append the metrics in g_metrics in the Prometheus text format
+/// \param out the output
+void metrics_render(std::string& out);
+
+/// \brief append one counter in the Prometheus text format
+/// \param out the output
+/// \param name the metric name
+/// \param help the help text
+/// \param value the value
+void metrics_render_counter(std::string& out, const char* name, const char* help, uint64_t value);
+
+/// \brief append one gauge in the Prometheus text format
+/// \param out the output
+/// \param name the metric name
+/// \param help the help text
+/// \param value the value
+void metrics_render_gauge(std::string& out, const char* name, const char* help, double value);
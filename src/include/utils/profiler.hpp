@@ -4,23 +4,190 @@
 /// \date 2025-06-24
 /// \version 0.9.7
 /// \note This class is used to profile the code.
+/// \note Every sample goes into a log-linear (HDR-style) latency histogram, so tails are not hidden by the average.
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include "utils/utils.hpp"
 
+/// \brief fixed-bucket latency histogram with per-thread shards
+/// \note Values are nanoseconds. Each power of two is split into 16 sub-buckets, so a bucket is within 6.25% of its values.
+/// \note record() is a few relaxed atomic adds on the caller's shard and never locks.
+class latency_histogram{
+public:
+    /// \brief sub-buckets per power of two, as a power of two
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr uint64_t SUB_BUCKETS = 1ull << SUB_BUCKET_BITS;
+    /// \brief buckets needed to cover every uint64_t value
+    static constexpr size_t BUCKET_NUM = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+    /// \brief number of shards, threads are spread over them round-robin
+    static constexpr size_t SHARD_NUM = 4;
+
+    latency_histogram() : shards(new shard_t[SHARD_NUM]) {
+        this->reset();
+    }
+
+    /// \brief record one sample
+    /// \param ns the sample, in nanoseconds
+    /// \param elements the number of elements processed in the sample, e.g. tokens
+    void record(uint64_t ns, uint64_t elements = 1){
+        shard_t& shard = this->shards[shard_index()];
+        shard.buckets[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+        shard.total_ns.fetch_add(ns, std::memory_order_relaxed);
+        shard.elements.fetch_add(elements, std::memory_order_relaxed);
+        uint64_t max_ns = shard.max_ns.load(std::memory_order_relaxed);
+        while (ns > max_ns && !shard.max_ns.compare_exchange_weak(max_ns, ns, std::memory_order_relaxed)){
+        }
+    }
+
+    /// \brief clear every shard
+    /// \note Not atomic with respect to concurrent record() calls, a racing sample may survive the reset
+    void reset(){
+        for (size_t s = 0; s < SHARD_NUM; s++){
+            shard_t& shard = this->shards[s];
+            for (auto& bucket : shard.buckets){
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            shard.total_ns.store(0, std::memory_order_relaxed);
+            shard.elements.store(0, std::memory_order_relaxed);
+            shard.max_ns.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /// \brief number of samples
+    uint64_t get_samples() const{
+        uint64_t samples = 0;
+        for (size_t s = 0; s < SHARD_NUM; s++){
+            for (const auto& bucket : this->shards[s].buckets){
+                samples += bucket.load(std::memory_order_relaxed);
+            }
+        }
+        return samples;
+    }
+
+    /// \brief sum of all samples, in nanoseconds
+    uint64_t get_total_ns() const{
+        uint64_t total = 0;
+        for (size_t s = 0; s < SHARD_NUM; s++){
+            total += this->shards[s].total_ns.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    /// \brief sum of the elements of all samples
+    uint64_t get_elements() const{
+        uint64_t elements = 0;
+        for (size_t s = 0; s < SHARD_NUM; s++){
+            elements += this->shards[s].elements.load(std::memory_order_relaxed);
+        }
+        return elements;
+    }
+
+    /// \brief largest sample, in nanoseconds
+    uint64_t get_max_ns() const{
+        uint64_t max_ns = 0;
+        for (size_t s = 0; s < SHARD_NUM; s++){
+            max_ns = std::max(max_ns, this->shards[s].max_ns.load(std::memory_order_relaxed));
+        }
+        return max_ns;
+    }
+
+    /// \brief percentile of the samples
+    /// \param percentile the percentile, 0 to 100
+    /// \return the midpoint of the bucket holding the percentile, in nanoseconds, 0 if there are no samples
+    uint64_t get_percentile_ns(double percentile) const{
+        std::array<uint64_t, BUCKET_NUM> merged{};
+        uint64_t samples = 0;
+        for (size_t s = 0; s < SHARD_NUM; s++){
+            for (size_t i = 0; i < BUCKET_NUM; i++){
+                uint64_t count = this->shards[s].buckets[i].load(std::memory_order_relaxed);
+                merged[i] += count;
+                samples += count;
+            }
+        }
+        if (samples == 0){
+            return 0;
+        }
+        percentile = std::min(std::max(percentile, 0.0), 100.0);
+        uint64_t rank = std::max<uint64_t>(1, (uint64_t)(percentile / 100.0 * samples + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_NUM; i++){
+            seen += merged[i];
+            if (seen >= rank){
+                // The top bucket is capped by the largest sample
+                return std::min(bucket_lower(i) + bucket_width(i) / 2, this->get_max_ns());
+            }
+        }
+        return this->get_max_ns();
+    }
+
+private:
+    /// \brief counters written by one group of threads
+    typedef struct alignas(64) {
+        std::atomic<uint64_t> buckets[BUCKET_NUM];
+        std::atomic<uint64_t> total_ns;
+        std::atomic<uint64_t> elements;
+        std::atomic<uint64_t> max_ns;
+    } shard_t;
+
+    /// \brief shard of the calling thread
+    static size_t shard_index(){
+        static std::atomic<size_t> next_shard{0};
+        thread_local size_t index = next_shard.fetch_add(1, std::memory_order_relaxed) % SHARD_NUM;
+        return index;
+    }
+
+    /// \brief bucket of a value, values below SUB_BUCKETS get one bucket each
+    static size_t bucket_index(uint64_t ns){
+        if (ns < SUB_BUCKETS){
+            return (size_t)ns;
+        }
+        int msb = 63 - std::countl_zero(ns);
+        int shift = msb - SUB_BUCKET_BITS;
+        return (size_t)(msb - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + (size_t)((ns >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    /// \brief smallest value of a bucket
+    static uint64_t bucket_lower(size_t index){
+        if (index < SUB_BUCKETS){
+            return index;
+        }
+        int shift = (int)(index / SUB_BUCKETS) - 1;
+        return (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+    }
+
+    /// \brief number of values in a bucket
+    static uint64_t bucket_width(size_t index){
+        if (index < SUB_BUCKETS){
+            return 1;
+        }
+        return 1ull << ((int)(index / SUB_BUCKETS) - 1);
+    }
+
+    std::unique_ptr<shard_t[]> shards;
+};
+
 /// \brief profiler class
+/// \note start()/stop() keep one start time and are meant for one thread at a time,
+///       use record() when several threads time the same phase.
 class profiler{
 public:
     profiler(){
-        this->start_time = time_utils::now();
-        this->counter = 0;
-        this->total_time = {0, "us"};
+        this->start_ns.store(to_ns(time_utils::now()), std::memory_order_relaxed);
+        this->counter.store(0, std::memory_order_relaxed);
     }
 
     /// \brief start the profiler
     time_utils::time_point start(){
-        this->start_time = time_utils::now();
-        return this->start_time;
+        time_utils::time_point start_time = time_utils::now();
+        this->start_ns.store(to_ns(start_time), std::memory_order_relaxed);
+        return start_time;
     }
 
     /// \brief stop the profiler
@@ -28,55 +195,99 @@ public:
     /// \param overwrite the overwrite flag
     time_utils::time_point stop(size_t elements, bool overwrite = false){
         time_utils::time_point end_time = time_utils::now();
-        time_utils::time_with_unit duration = time_utils::duration_us(this->start_time, end_time);
-        this->total_time.first += duration.first;
-        if (overwrite){
-            this->counter = elements;
-        }
-        else{
-            this->counter += elements;
-        }
+        int64_t duration = to_ns(end_time) - this->start_ns.load(std::memory_order_relaxed);
+        this->add(duration > 0 ? (uint64_t)duration : 0, elements, overwrite);
+        return end_time;
+    }
+
+    /// \brief record a sample timed by the caller, safe to call from any thread
+    /// \param start_time the start of the sample
+    /// \param elements the number of elements
+    time_utils::time_point record(time_utils::time_point start_time, size_t elements){
+        time_utils::time_point end_time = time_utils::now();
+        int64_t duration = to_ns(end_time) - to_ns(start_time);
+        this->add(duration > 0 ? (uint64_t)duration : 0, elements, false);
         return end_time;
     }
 
+    /// \brief record a sample measured elsewhere, safe to call from any thread
+    /// \param ns the sample, in nanoseconds
+    /// \param elements the number of elements
+    void record_ns(uint64_t ns, size_t elements = 1){
+        this->add(ns, elements, false);
+    }
+
     /// \brief reset the profiler
     void reset(){
-        this->start_time = time_utils::now();
-        this->counter = 0;
-        this->total_time = {0, "us"};
+        this->start_ns.store(to_ns(time_utils::now()), std::memory_order_relaxed);
+        this->counter.store(0, std::memory_order_relaxed);
+        this->histogram.reset();
     }
 
     /// \brief get the total time
     /// \return the total time
     time_utils::time_with_unit get_total_time(){
-        time_utils::time_with_unit auto_time = time_utils::re_unit(this->total_time);
+        time_utils::time_with_unit total_time = {(float)(this->histogram.get_total_ns() / 1000), "us"};
+        time_utils::time_with_unit auto_time = time_utils::re_unit(total_time);
         return auto_time;
     }
 
     /// \brief get the average time
     /// \return the average time
     float get_average_time(){
-        time_utils::time_with_unit time_in_second = time_utils::cast_to_s(this->total_time);
-        return time_in_second.first / this->counter;
+        return (float)(this->histogram.get_total_ns() * 1e-9 / this->get_counter());
     }
 
     /// \brief get the average speed
     /// \return the average speed
     float get_average_speed(){
-        time_utils::time_with_unit time_in_second = time_utils::cast_to_s(this->total_time);
-        return this->counter / time_in_second.first;
+        return (float)(this->get_counter() / (this->histogram.get_total_ns() * 1e-9));
     }
 
     /// \brief get the counter
     /// \return the counter
     size_t get_counter(){
-        return this->counter;
+        return this->counter.load(std::memory_order_relaxed);
+    }
+
+    /// \brief get a percentile of the sample durations
+    /// \param percentile the percentile, 0 to 100
+    /// \return the percentile
+    time_utils::time_with_unit get_percentile(double percentile){
+        time_utils::time_with_unit time = {(float)(this->histogram.get_percentile_ns(percentile) / 1000.0), "us"};
+        return time_utils::re_unit(time);
+    }
+
+    /// \brief get the number of samples
+    /// \return the number of samples
+    uint64_t get_samples(){
+        return this->histogram.get_samples();
+    }
+
+    /// \brief get the histogram of the sample durations
+    /// \return the histogram
+    const latency_histogram& get_histogram() const{
+        return this->histogram;
     }
+
 private:
-    time_utils::time_point start_time;
-    time_utils::time_point last_time;
-    time_utils::time_with_unit total_time;
-    size_t counter;
-    std::vector<time_utils::time_with_unit> time_list; // time_list[0] is the total time, time_list[1] is the average time per element
+    /// \brief time point to nanoseconds since the clock epoch
+    static int64_t to_ns(time_utils::time_point time){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    /// \brief add a sample
+    void add(uint64_t ns, size_t elements, bool overwrite){
+        this->histogram.record(ns, elements);
+        if (overwrite){
+            this->counter.store(elements, std::memory_order_relaxed);
+        }
+        else{
+            this->counter.fetch_add(elements, std::memory_order_relaxed);
+        }
+    }
 
-};
\ No newline at end of file
+    std::atomic<int64_t> start_ns;
+    std::atomic<size_t> counter;
+    latency_histogram histogram;
+};
@@ -0,0 +1,119 @@
+/// \file trace.hpp
+/// \brief scoped trace spans, exported in the Chrome trace event format
+/// \author FastFlowLM Team
+/// \date 2025-08-05
+/// \version 0.9.7
+/// \note Load the dumps in chrome://tracing or https://ui.perfetto.dev
+/// \note A disabled span costs one relaxed atomic load.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/// \brief tracing switch, see trace_set_enabled()
+extern std::atomic<bool> g_trace_enabled;
+
+/// \brief check if tracing is enabled
+/// \return true if spans are recorded
+inline bool trace_enabled() {
+    return g_trace_enabled.load(std::memory_order_relaxed);
+}
+
+/// \brief enable or disable tracing
+/// \param enabled the switch
+void trace_set_enabled(bool enabled);
+
+/// \brief read FLM_TRACE (1 enables tracing) and FLM_TRACE_DIR (write one trace file per request there)
+void trace_init_from_env();
+
+/// \brief allocate an id for a request, spans recorded while it is current are tagged with it
+/// \return the id, never 0
+uint64_t trace_new_request();
+
+/// \brief the request current on this thread
+/// \return the id, 0 if none
+uint64_t trace_current_request();
+
+/// \brief finish a request, its spans are written to FLM_TRACE_DIR/trace_<id>.json if a directory is set
+/// \param request the request id
+void trace_finish_request(uint64_t request);
+
+/// \brief append the recorded spans as a Chrome trace JSON object
+/// \param out the output
+/// \param request only spans of this request, 0 for all spans
+/// \param clear remove the exported spans
+void trace_dump(std::string& out, uint64_t request = 0, bool clear = true);
+
+/// \brief number of spans dropped because a thread buffer was full
+/// \return the number of dropped spans
+uint64_t trace_dropped_spans();
+
+/// \brief record a complete span, used by trace_span
+/// \param name the span name, must outlive the trace, e.g. a string literal
+/// \param category the category, must outlive the trace
+/// \param start_ns the start, from trace_now_ns()
+/// \param end_ns the end, from trace_now_ns()
+void trace_record(const char* name, const char* category, uint64_t start_ns, uint64_t end_ns);
+
+/// \brief nanoseconds since the trace epoch
+/// \return the time
+uint64_t trace_now_ns();
+
+/// \brief makes a request current on this thread for its lifetime
+/// \note Declare it before the spans of the scope, so they are closed when the request is finished
+class trace_request_scope {
+public:
+    /// \brief constructor
+    /// \param request the request id, 0 to trace nothing
+    /// \param finish call trace_finish_request() when the scope ends
+    trace_request_scope(uint64_t request, bool finish = false);
+    ~trace_request_scope();
+
+    /// \brief the request continues on another thread, which finishes it
+    void hand_off() { this->finish = false; }
+
+    trace_request_scope(const trace_request_scope&) = delete;
+    trace_request_scope& operator=(const trace_request_scope&) = delete;
+
+private:
+    /// \brief the request
+    uint64_t request;
+    /// \brief the request that was current before
+    uint64_t previous;
+    /// \brief finish the request when the scope ends
+    bool finish;
+};
+
+/// \brief records a span from construction to destruction
+class trace_span {
+public:
+    trace_span(const char* name, const char* category = "flm")
+        : name(name), category(category), start_ns(trace_enabled() ? trace_now_ns() : 0) {}
+
+    ~trace_span() {
+        if (this->start_ns != 0) {
+            trace_record(this->name, this->category, this->start_ns, trace_now_ns());
+        }
+    }
+
+    trace_span(const trace_span&) = delete;
+    trace_span& operator=(const trace_span&) = delete;
+
+private:
+    const char* name;
+    const char* category;
+    uint64_t start_ns;
+};
+
+#define FLM_TRACE_CONCAT_INNER(a, b) a##b
+#define FLM_TRACE_CONCAT(a, b) FLM_TRACE_CONCAT_INNER(a, b)
+
+/// \brief trace the rest of the enclosing scope
+/// \param name the span name, a string literal
+#define TRACE_SPAN(name) trace_span FLM_TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+/// \brief trace the rest of the enclosing scope under a category
+/// \param name the span name, a string literal
+/// \param category the category, a string literal
+#define TRACE_SPAN_CAT(name, category) trace_span FLM_TRACE_CONCAT(trace_span_, __LINE__)(name, category)
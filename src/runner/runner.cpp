@@ -348,6 +348,10 @@ void Runner::cmd_set(std::vector<std::string>& input_list) {
         std::cout << "  /set system_prompt [value] - set the system prompt" << std::endl;
         std::cout << "  /set context_length [value] - set the context length" << std::endl;
         std::cout << "  /set generate_limit [value] - set the generate limit" << std::endl;
+        std::cout << "  /set seed [value] - set the sampling seed, -1 for random" << std::endl;
+        std::cout << "  /set min_p [value] - set the min-p, 0 to disable" << std::endl;
+        std::cout << "  /set typical_p [value] - set the typical-p, 1 to disable" << std::endl;
+        std::cout << "  /set mirostat [value] - set the mirostat version, 0 to disable" << std::endl;
         return;
     }
     
@@ -395,6 +399,18 @@ void Runner::cmd_set(std::vector<std::string>& input_list) {
     else if (set_context == "generate_limit"){
         this->generate_limit = std::stoi(set_value);
     }
+    else if (set_context == "seed"){
+        this->chat_engine->set_seed(std::stoll(set_value));
+    }
+    else if (set_context == "min_p"){
+        this->chat_engine->set_min_p(std::stof(set_value));
+    }
+    else if (set_context == "typical_p"){
+        this->chat_engine->set_typical_p(std::stof(set_value));
+    }
+    else if (set_context == "mirostat"){
+        this->chat_engine->set_mirostat(std::stoi(set_value));
+    }
     else{
         std::cout << "Invalid context: " << set_context << std::endl;
         std::cout << "Available parameters: " << std::endl;
@@ -406,6 +422,10 @@ void Runner::cmd_set(std::vector<std::string>& input_list) {
         std::cout << "  /set frequency_penalty [value] - set the frequency penalty" << std::endl;   
         std::cout << "  /set system_prompt [value] - set the system prompt" << std::endl;
         std::cout << "  /set generate_limit [value] - set the generate limit" << std::endl;
+        std::cout << "  /set seed [value] - set the sampling seed, -1 for random" << std::endl;
+        std::cout << "  /set min_p [value] - set the min-p, 0 to disable" << std::endl;
+        std::cout << "  /set typical_p [value] - set the typical-p, 1 to disable" << std::endl;
+        std::cout << "  /set mirostat [value] - set the mirostat version, 0 to disable" << std::endl;
     }
 }
 
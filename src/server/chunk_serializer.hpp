@@ -0,0 +1,166 @@
+/*!
+ *  Copyright (c) 2023 by Contributors
+ * \file chunk_serializer.hpp
+ * \brief Serializer for streamed token chunks, Ollama NDJSON and OpenAI SSE
+ * \author FastFlowLM Team
+ * \date 2025-08-05
+ * \version 0.9.7
+ */
+#pragma once
+
+#include <bit>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define FLM_JSON_ESCAPE_SSE2 1
+#else
+#define FLM_JSON_ESCAPE_SSE2 0
+#endif
+
+using json = nlohmann::ordered_json;
+
+///@brief Append a string as the body of a JSON string literal
+///@param out the buffer to append to
+///@param s the raw UTF-8 string
+///@note Escapes like nlohmann::json::dump: \" \\ \b \f \n \r \t, other control characters as \u00XX
+///@note Runs without escapes are found 16 bytes at a time and copied in one append
+inline void json_escape_append(std::string& out, std::string_view s) {
+    static const char hex_digits[] = "0123456789abcdef";
+    const char* p = s.data();
+    const char* end = p + s.size();
+    while (p < end) {
+        const char* run = p;
+#if FLM_JSON_ESCAPE_SSE2
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i space = _mm_set1_epi8(0x20);
+        while (end - p >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            // v >= 0x20 as unsigned bytes, the signed compare would flag every UTF-8 byte
+            __m128i printable = _mm_cmpeq_epi8(_mm_max_epu8(v, space), v);
+            __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+            int mask = _mm_movemask_epi8(_mm_or_si128(special, _mm_andnot_si128(printable, _mm_set1_epi8(-1))));
+            if (mask != 0) {
+                p += std::countr_zero(static_cast<unsigned int>(mask));
+                break;
+            }
+            p += 16;
+        }
+#endif
+        while (p < end) {
+            unsigned char c = static_cast<unsigned char>(*p);
+            if (c < 0x20 || c == '"' || c == '\\') {
+                break;
+            }
+            p++;
+        }
+        out.append(run, p);
+        if (p == end) {
+            break;
+        }
+
+        unsigned char c = static_cast<unsigned char>(*p++);
+        switch (c) {
+            case '"':  out.append("\\\""); break;
+            case '\\': out.append("\\\\"); break;
+            case '\b': out.append("\\b"); break;
+            case '\f': out.append("\\f"); break;
+            case '\n': out.append("\\n"); break;
+            case '\r': out.append("\\r"); break;
+            case '\t': out.append("\\t"); break;
+            default: {
+                char escaped[6] = {'\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xF]};
+                out.append(escaped, sizeof(escaped));
+                break;
+            }
+        }
+    }
+}
+
+///@brief chunk format
+typedef enum {
+    CHUNK_OLLAMA_CHAT,      // {"model":...,"message":{"role":"assistant","content":...},"done":...}\n
+    CHUNK_OLLAMA_GENERATE,  // {"model":...,"response":...,"done":...}\n
+    CHUNK_OPENAI_SSE        // data: {"id":...,"object":"chat.completion.chunk","choices":[{"delta":{"content":...},"index":0}]}\n\n
+} chunk_format_t;
+
+///@brief Renders streamed chunks into one reused buffer
+///@note Content chunks are a pre-rendered prefix, the escaped text and a pre-rendered suffix, no JSON DOM is built per token
+///@note The returned views are valid until the next render call
+class chunk_serializer {
+public:
+    ///@brief constructor
+    ///@param format the chunk format
+    ///@param model the model name, used by the Ollama formats
+    ///@param stream_id the stream id, used by the OpenAI format
+    chunk_serializer(chunk_format_t format, const std::string& model, const std::string& stream_id = "")
+        : format(format) {
+        switch (format) {
+            case CHUNK_OLLAMA_CHAT:
+                content_prefix = "{\"model\":\"";
+                json_escape_append(content_prefix, model);
+                content_prefix += "\",\"message\":{\"role\":\"assistant\",\"content\":\"";
+                content_suffix = "\"},\"done\":false}\n";
+                final_content_suffix = "\"},\"done\":true}\n";
+                break;
+            case CHUNK_OLLAMA_GENERATE:
+                content_prefix = "{\"model\":\"";
+                json_escape_append(content_prefix, model);
+                content_prefix += "\",\"response\":\"";
+                content_suffix = "\",\"done\":false}\n";
+                final_content_suffix = "\",\"done\":true}\n";
+                break;
+            case CHUNK_OPENAI_SSE:
+                content_prefix = "data: {\"id\":\"";
+                json_escape_append(content_prefix, stream_id);
+                content_prefix += "\",\"object\":\"chat.completion.chunk\",\"choices\":[{\"delta\":{\"content\":\"";
+                content_suffix = "\"},\"index\":0}]}\n\n";
+                final_content_suffix = content_suffix;
+                break;
+        }
+        buffer.reserve(1024);
+    }
+
+    ///@brief render a content chunk
+    ///@param content the decoded text
+    ///@param done the value of the Ollama "done" field
+    ///@return the chunk bytes
+    std::string_view render_content(std::string_view content, bool done = false) {
+        buffer.clear();
+        buffer += content_prefix;
+        json_escape_append(buffer, content);
+        buffer += done ? final_content_suffix : content_suffix;
+        return buffer;
+    }
+
+    ///@brief render a JSON value as one NDJSON line or SSE event, for the rare non-token chunks
+    ///@param value the value
+    ///@return the chunk bytes
+    std::string_view render_json(const json& value) {
+        buffer.clear();
+        if (format == CHUNK_OPENAI_SSE) {
+            buffer += "data: ";
+            buffer += value.dump();
+            buffer += "\n\n";
+        } else {
+            buffer += value.dump();
+            buffer += "\n";
+        }
+        return buffer;
+    }
+
+private:
+    ///@brief chunk format
+    chunk_format_t format;
+    ///@brief pre-rendered bytes before the content
+    std::string content_prefix;
+    ///@brief pre-rendered bytes after the content
+    std::string content_suffix;
+    ///@brief pre-rendered bytes after the content of the final Ollama chunk
+    std::string final_content_suffix;
+    ///@brief reused output buffer
+    std::string buffer;
+};
@@ -0,0 +1,113 @@
+/*!
+ *  Copyright (c) 2023 by Contributors
+ * \file inference_executor.hpp
+ * \brief Worker pool that runs NPU-bound requests off the I/O threads
+ * \author FastFlowLM Team
+ * \date 2025-08-05
+ * \version 0.9.7
+ */
+#pragma once
+
+#include "utils/debug_utils.hpp"
+#include <condition_variable>
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+///@brief InferenceExecutor class
+///@note Jobs run in submission order on dedicated worker threads, so that the
+///@note Boost.Asio I/O threads only parse requests and write responses.
+///@note Results are handed back to the I/O threads by posting to the session strand.
+class InferenceExecutor {
+public:
+    using job_t = std::function<void()>;
+
+    InferenceExecutor() : stopping_(false) {}
+
+    ~InferenceExecutor() {
+        stop();
+    }
+
+    ///@brief start the workers
+    ///@param num_workers the number of worker threads
+    void start(size_t num_workers) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = false;
+        for (size_t i = 0; i < std::max<size_t>(num_workers, 1); ++i) {
+            workers_.emplace_back([this]() { worker_loop(); });
+        }
+    }
+
+    ///@brief stop the workers, running jobs are finished and pending jobs are dropped
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            jobs_.clear();
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        workers_.clear();
+    }
+
+    ///@brief submit a job
+    ///@param job the job
+    void submit(job_t job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        cv_.notify_one();
+    }
+
+    ///@brief get the number of jobs waiting for a worker
+    ///@return the number of pending jobs
+    size_t pending() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return jobs_.size();
+    }
+
+private:
+    ///@brief worker loop
+    void worker_loop() {
+        while (true) {
+            job_t job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+                if (stopping_) {
+                    return;
+                }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            // A throwing job must not take the worker, and with it the server, down
+            try {
+                job();
+            } catch (const std::exception& e) {
+                header_print("ERROR", "Inference job failed: " << e.what());
+            } catch (...) {
+                header_print("ERROR", "Inference job failed with an unknown exception");
+            }
+        }
+    }
+
+    ///@brief mutex guarding the job queue
+    mutable std::mutex mutex_;
+    ///@brief job queue condition variable
+    std::condition_variable cv_;
+    ///@brief job queue
+    std::deque<job_t> jobs_;
+    ///@brief worker threads
+    std::vector<std::thread> workers_;
+    ///@brief stopping flag
+    bool stopping_;
+};
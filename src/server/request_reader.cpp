@@ -0,0 +1,150 @@
+/*!
+ *  Copyright (c) 2023 by Contributors
+ * \file request_reader.cpp
+ * \brief Request body parser that leaves large image fields in the body
+ * \author FastFlowLM Team
+ * \date 2025-08-05
+ * \version 0.9.7
+ */
+#include "request_reader.hpp"
+#include <cstring>
+#include <iterator>
+#include <string>
+
+namespace {
+
+///@brief Input iterator over the body that publishes how far the lexer has read
+class body_iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char*;
+    using reference = const char&;
+
+    body_iterator(const char* pos, const char** cursor) : pos(pos), cursor(cursor) {}
+
+    reference operator*() const { return *pos; }
+    body_iterator& operator++() {
+        ++pos;
+        *cursor = pos;
+        return *this;
+    }
+    body_iterator operator++(int) {
+        body_iterator previous = *this;
+        ++(*this);
+        return previous;
+    }
+    bool operator==(const body_iterator& other) const { return pos == other.pos; }
+    bool operator!=(const body_iterator& other) const { return pos != other.pos; }
+
+private:
+    ///@brief current position
+    const char* pos;
+    ///@brief shared with the reader, the position after the last consumed character
+    const char** cursor;
+};
+
+using body_input_adapter = nlohmann::detail::iterator_input_adapter<body_iterator>;
+
+///@brief SAX handler that builds the document like json::parse, except for messages[*].images[*]
+class image_extracting_sax {
+public:
+    using number_integer_t = json::number_integer_t;
+    using number_unsigned_t = json::number_unsigned_t;
+    using number_float_t = json::number_float_t;
+    using string_t = json::string_t;
+    using binary_t = json::binary_t;
+
+    image_extracting_sax(std::string_view body, const char** cursor, json& request, std::vector<std::string_view>& images)
+        : body(body), cursor(cursor), images(images), dom(request, true) {}
+
+    bool null() { return dom.null(); }
+    bool boolean(bool val) { return dom.boolean(val); }
+    bool number_integer(number_integer_t val) { return dom.number_integer(val); }
+    bool number_unsigned(number_unsigned_t val) { return dom.number_unsigned(val); }
+    bool number_float(number_float_t val, const string_t& s) { return dom.number_float(val, s); }
+    bool binary(binary_t& val) { return dom.binary(val); }
+
+    bool string(string_t& val) {
+        if (!in_image_array()) {
+            return dom.string(val);
+        }
+        // The lexer has just consumed the closing quote; without escapes the raw bytes equal the value
+        const char* end = *cursor - 1;
+        const char* start = end - val.size();
+        if (start > body.data() && start[-1] == '"' && std::memcmp(start, val.data(), val.size()) == 0) {
+            images.push_back(std::string_view(start, val.size()));
+            string_t placeholder;
+            return dom.string(placeholder);
+        }
+        images.push_back(std::string_view());
+        return dom.string(val);
+    }
+
+    bool start_object(std::size_t len) {
+        frames.push_back({false, std::string()});
+        return dom.start_object(len);
+    }
+    bool key(string_t& val) {
+        frames.back().key = val;
+        return dom.key(val);
+    }
+    bool end_object() {
+        frames.pop_back();
+        return dom.end_object();
+    }
+    bool start_array(std::size_t len) {
+        frames.push_back({true, std::string()});
+        return dom.start_array(len);
+    }
+    bool end_array() {
+        frames.pop_back();
+        return dom.end_array();
+    }
+
+    template<class Exception>
+    bool parse_error(std::size_t position, const std::string& last_token, const Exception& ex) {
+        return dom.parse_error(position, last_token, ex);
+    }
+
+private:
+    ///@brief true inside {"messages": [{"images": [ ... ]}]}
+    bool in_image_array() const {
+        return frames.size() == 4
+            && !frames[0].is_array && frames[0].key == "messages"
+            && frames[1].is_array
+            && !frames[2].is_array && frames[2].key == "images"
+            && frames[3].is_array;
+    }
+
+    ///@brief open container
+    typedef struct {
+        bool is_array;
+        std::string key;    // last key seen, objects only
+    } frame_t;
+
+    ///@brief raw body
+    std::string_view body;
+    ///@brief lexer position
+    const char** cursor;
+    ///@brief extracted images
+    std::vector<std::string_view>& images;
+    ///@brief open containers, outermost first
+    std::vector<frame_t> frames;
+    ///@brief builds the document
+    nlohmann::detail::json_sax_dom_parser<json, body_input_adapter> dom;
+};
+
+} // namespace
+
+///@brief parse a request body, the base64 images of chat messages are not copied into the document
+///@param body the raw request body, must outlive the returned views
+///@param request the parsed document
+///@param images views into body, in document order
+void parse_request_body(std::string_view body, json& request, std::vector<std::string_view>& images) {
+    images.clear();
+    const char* cursor = body.data();
+    image_extracting_sax sax(body, &cursor, request, images);
+    json::sax_parse(body_iterator(body.data(), &cursor), body_iterator(body.data() + body.size(), &cursor), &sax);
+}
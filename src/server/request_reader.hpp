@@ -0,0 +1,23 @@
+/*!
+ *  Copyright (c) 2023 by Contributors
+ * \file request_reader.hpp
+ * \brief Request body parser that leaves large image fields in the body
+ * \author FastFlowLM Team
+ * \date 2025-08-05
+ * \version 0.9.7
+ */
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::ordered_json;
+
+///@brief parse a request body, the base64 images of chat messages are not copied into the document
+///@param body the raw request body, must outlive the returned views
+///@param request the parsed document, every messages[*].images[*] that was extracted holds an empty string
+///@param images one entry per messages[*].images[*] in document order, a view into body,
+///       or empty if the field used JSON escapes and was left in the document
+///@throw json::parse_error, same as json::parse
+void parse_request_body(std::string_view body, json& request, std::vector<std::string_view>& images);
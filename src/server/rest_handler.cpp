@@ -7,10 +7,12 @@
  * \version 0.9.7
  */
 #include "rest_handler.hpp"
+#include "server.hpp"
 #include "wstream_buf.hpp"
 #include "streaming_ostream.hpp"
 #include "streaming_ostream_openai.hpp"
 #include "image/image_reader.hpp"
+#include "utils/metrics.hpp"
 #include <sstream>
 #include <iostream>
 #include <thread>
@@ -19,6 +21,29 @@
 #include <locale>
 #include <random>
 
+///@brief Build the per-token cancellation check for chat_bot::generate
+///@param cancellation_token the cancellation token of the request, may be null
+///@return the cancellation check, null if the request cannot be cancelled
+static cancel_check_t make_cancel_check(std::shared_ptr<CancellationToken> cancellation_token) {
+    if (!cancellation_token) {
+        return nullptr;
+    }
+    return [cancellation_token]() { return cancellation_token->cancelled(); };
+}
+
+///@brief Read the streaming coalescing window of a request
+///@param request the request, OpenAI clients set the fields at the top level
+///@param options the Ollama "options" object
+///@return the window, one chunk per token unless "stream_interval_ms" or "stream_min_tokens" is set
+static stream_coalesce_t parse_stream_coalesce(const json& request, const json& options) {
+    stream_coalesce_t coalesce = {0, 1};
+    coalesce.interval_ms = options.value("stream_interval_ms", request.value("stream_interval_ms", 0));
+    coalesce.min_tokens = options.value("stream_min_tokens", request.value("stream_min_tokens", 1));
+    coalesce.interval_ms = std::max(coalesce.interval_ms, 0);
+    coalesce.min_tokens = std::max(coalesce.min_tokens, 1);
+    return coalesce;
+}
+
 ///@brief RestHandler constructor
 ///@param models the model list
 ///@param downloader the downloader
@@ -44,7 +69,9 @@ void RestHandler::ensure_model_loaded(const std::string& model_tag) {
         }
         std::string tag_copy = model_tag; // Create non-const copy
         nlohmann::json model_info = supported_models.get_model_info(tag_copy);
+        auto load_start_time = time_utils::now();
         chat_engine->load_model(supported_models.get_model_path(tag_copy), model_info);
+        g_metrics.model_load_seconds.observe(time_utils::duration_ns(load_start_time, time_utils::now()).first * 1e-9);
         current_model_tag = model_tag;
     }
 }
@@ -65,6 +92,12 @@ void RestHandler::handle_generate(const json& request,
         int temperature = options.value("temperature", 0.6);
         int top_p = options.value("top_p", 0.9);
         int top_k = options.value("top_k", 5);
+        int64_t seed = options.value("seed", (int64_t)-1);
+        float min_p = options.value("min_p", 0.0);
+        float typical_p = options.value("typical_p", 1.0);
+        int mirostat = options.value("mirostat", 0);
+        float mirostat_tau = options.value("mirostat_tau", 5.0);
+        float mirostat_eta = options.value("mirostat_eta", 0.1);
         float frequency_penalty = options.value("frequency_penalty", 1.1);
         float repetition_penalty = options.value("repeat_penalty", 1.1);
         int length_limit = request.value("max_tokens", 4096);
@@ -72,12 +105,21 @@ void RestHandler::handle_generate(const json& request,
         auto load_start_time = time_utils::now();
         ensure_model_loaded(model);
         auto load_end_time = time_utils::now();
+        if (chat_context_cached) {
+            // The KV cache holds a chat conversation kept for prefix reuse, do not continue it
+            chat_engine->clear_context();
+            chat_context_cached = false;
+        }
         chat_engine->set_enable_think(enable_thinking);
         chat_engine->set_frequency_penalty(frequency_penalty);
         chat_engine->set_repetition_penalty(repetition_penalty);
         chat_engine->set_topp(top_p);
         chat_engine->set_topk(top_k);
         chat_engine->set_temperature(temperature);
+        chat_engine->set_seed(seed);
+        chat_engine->set_min_p(min_p);
+        chat_engine->set_typical_p(typical_p);
+        chat_engine->set_mirostat(mirostat, mirostat_tau, mirostat_eta);
         chat_meta_info meta_info;
         
         meta_info.load_duration = (uint64_t)time_utils::duration_ns(load_start_time, load_end_time).first;
@@ -86,7 +128,7 @@ void RestHandler::handle_generate(const json& request,
         if (stream) {
             // Streaming response using streaming_ostream
             auto total_start_time = time_utils::now();
-            streaming_ostream ostream(model, send_streaming_response, false);
+            streaming_ostream ostream(model, send_streaming_response, false, parse_stream_coalesce(request, options));
             std::vector<int> prompts = chat_engine->tokenize(prompt, true, "user", true);
             bool success = chat_engine->insert(meta_info, prompts);
             if (!success){
@@ -94,7 +136,7 @@ void RestHandler::handle_generate(const json& request,
                 send_response(error_response);
                 return;
             }
-            chat_engine->generate(meta_info, length_limit, ostream);
+            chat_engine->generate(meta_info, length_limit, ostream, make_cancel_check(cancellation_token));
             auto total_end_time = time_utils::now();
             auto history = this->chat_engine->get_history();
             // std::cout << "history: " << history.first << std::endl;
@@ -112,7 +154,7 @@ void RestHandler::handle_generate(const json& request,
                 send_response(error_response);
                 return;
             }
-            chat_engine->generate(meta_info, length_limit, ostream);
+            chat_engine->generate(meta_info, length_limit, ostream, make_cancel_check(cancellation_token));
             std::string response_text = ss.str();
             auto history = this->chat_engine->get_history();
             json response = {
@@ -139,20 +181,28 @@ void RestHandler::handle_generate(const json& request,
 
 ///@brief Handle the chat request
 ///@param request the request
+///@param images the base64 images of the messages, views into the request body
 ///@param send_response the send response
 ///@param send_streaming_response the send streaming response
-void RestHandler::handle_chat(const json& request,
+void RestHandler::handle_chat(json& request,
+                             const std::vector<std::string_view>& images,
                              std::function<void(const json&)> send_response,
                              StreamResponseCallback send_streaming_response,
                              std::shared_ptr<CancellationToken> cancellation_token) {
     try {
-        nlohmann::ordered_json messages = request["messages"];
+        nlohmann::ordered_json& messages = request.at("messages");
         bool stream = request.value("stream", false);
         std::string model = request.value("model", default_model_tag);
         json options = request.value("options", json::object());
         float temperature = options.value("temperature", 0.6);
         float top_p = options.value("top_p", 0.9);
         int top_k = options.value("top_k", 5);
+        int64_t seed = options.value("seed", (int64_t)-1);
+        float min_p = options.value("min_p", 0.0);
+        float typical_p = options.value("typical_p", 1.0);
+        int mirostat = options.value("mirostat", 0);
+        float mirostat_tau = options.value("mirostat_tau", 5.0);
+        float mirostat_eta = options.value("mirostat_eta", 0.1);
         float frequency_penalty = options.value("frequency_penalty", 1.1);
         float repetition_penalty = options.value("repeat_penalty", 1.1);
         int length_limit = options.value("num_predict", 4096);
@@ -162,9 +212,8 @@ void RestHandler::handle_chat(const json& request,
         auto load_end_time = time_utils::now();
         int total_images = 0;
         for (auto& message : messages){
-            nlohmann::ordered_json::array_t images = message.value("images", nlohmann::ordered_json::array());
-            if (images.size() > 0){
-                total_images += images.size();
+            if (message.contains("images")){
+                total_images += message["images"].size();
             }
         }
         header_print("FLM", "Total images: " << total_images);
@@ -172,10 +221,17 @@ void RestHandler::handle_chat(const json& request,
         bytes pixel_values(3 * 896 * 896 * sizeof(bf16) * total_images);
         uint8_t* pixel_values_ptr = pixel_values.data();
         if (total_images > 0){
+            size_t image_index = 0;
             for (auto& message : messages){
-                nlohmann::ordered_json::array_t images = message.value("images", nlohmann::ordered_json::array());
-                for (auto& image : images){
-                    std::string image_str = image.get<std::string>();
+                if (!message.contains("images")){
+                    continue;
+                }
+                for (auto& image : message["images"]){
+                    // Decode from the request body, images with JSON escapes were kept in the document
+                    std::string_view image_str = image_index < images.size() && !images[image_index].empty()
+                        ? images[image_index]
+                        : std::string_view(image.get_ref<const std::string&>());
+                    image_index++;
                     bytes image_rgb = load_image_base64(image_str);
                     buffer<bf16> pv = preprocess_image(image_rgb);
                     memcpy(pixel_values_ptr, pv.data(), pv.size() * sizeof(bf16));
@@ -186,38 +242,42 @@ void RestHandler::handle_chat(const json& request,
         chat_engine->set_temperature(temperature);
         chat_engine->set_topp(top_p);
         chat_engine->set_topk(top_k);
+        chat_engine->set_seed(seed);
+        chat_engine->set_min_p(min_p);
+        chat_engine->set_typical_p(typical_p);
+        chat_engine->set_mirostat(mirostat, mirostat_tau, mirostat_eta);
         chat_engine->set_frequency_penalty(frequency_penalty);
         chat_engine->set_repetition_penalty(repetition_penalty);
         chat_engine->set_enable_think(enable_thinking);
         chat_meta_info meta_info;
+        chat_context_cached = true;
         meta_info.load_duration = (uint64_t)time_utils::duration_ns(load_start_time, load_end_time).first;
         void* payload = pixel_values.size() > 0 ? static_cast<void*>(&pixel_values) : nullptr;
         header_print("FLM", "Start generating...");
         if (stream) {
             // Streaming response using streaming_ostream
             auto total_start_time = time_utils::now();
-            streaming_ostream ostream(model, send_streaming_response, true);  // true for chat format
+            streaming_ostream ostream(model, send_streaming_response, true, parse_stream_coalesce(request, options));  // true for chat format
             std::vector<int> prompts = chat_engine->tokenize(messages, true);
-            bool success = chat_engine->insert(meta_info, prompts, false, payload);
+            bool success = chat_engine->insert_with_prefix_cache(meta_info, prompts, payload);
             if (!success){
                 json error_response = {{"error", "Max length reached"}};
                 send_response(error_response);
                 return;
             }
-            chat_engine->generate(meta_info, length_limit, ostream);
+            chat_engine->generate(meta_info, length_limit, ostream, make_cancel_check(cancellation_token));
             auto total_end_time = time_utils::now();
             meta_info.total_duration = (uint64_t)time_utils::duration_ns(total_start_time, total_end_time).first;
             
             ostream.finalize_chat(meta_info);
             // auto history = this->chat_engine->get_history();
             // std::cout << "history: " << history.first << std::endl;
-            this->chat_engine->clear_context();
         } else {
             // Non-streaming response
             std::vector<int> prompts = chat_engine->tokenize(messages, true);
             auto total_start_time = time_utils::now();
             nullstream nstream;
-            std::string response_text = chat_engine->generate_with_prompt(meta_info, prompts, length_limit, std::cout, payload);
+            std::string response_text = chat_engine->generate_with_prompt(meta_info, prompts, length_limit, std::cout, payload, make_cancel_check(cancellation_token));
             auto total_end_time = time_utils::now();
             meta_info.total_duration = (uint64_t)time_utils::duration_ns(total_start_time, total_end_time).first;
             
@@ -241,7 +301,6 @@ void RestHandler::handle_chat(const json& request,
             
             // auto history = this->chat_engine->get_history();
             // std::cout << "history: " << history.first << std::endl;
-            this->chat_engine->clear_context();
         }
     } catch (const std::exception& e) {
         json error_response = {{"error", e.what()}};
@@ -417,12 +476,12 @@ void RestHandler::handle_create(const json& request,
 ///@param request the request
 ///@param send_response the send response
 ///@param send_streaming_response the send streaming response
-void RestHandler::handle_openai_chat_completion(const json& request,
+void RestHandler::handle_openai_chat_completion(json& request,
                                                std::function<void(const json&)> send_response,
                                                StreamResponseCallback send_streaming_response,
                                                std::shared_ptr<CancellationToken> cancellation_token) {
     try {
-        nlohmann::ordered_json messages = request["messages"];
+        nlohmann::ordered_json& messages = request.at("messages");
         std::string model = request.value("model", default_model_tag);
         bool stream = request.value("stream", false);
         
@@ -431,6 +490,12 @@ void RestHandler::handle_openai_chat_completion(const json& request,
         float temperature = request.value("temperature", 0.6);
         float top_p = request.value("top_p", 0.9);
         int top_k = request.value("top_k", 5);
+        int64_t seed = request.value("seed", options.value("seed", (int64_t)-1));
+        float min_p = request.value("min_p", options.value("min_p", 0.0));
+        float typical_p = request.value("typical_p", options.value("typical_p", 1.0));
+        int mirostat = request.value("mirostat", options.value("mirostat", 0));
+        float mirostat_tau = request.value("mirostat_tau", options.value("mirostat_tau", 5.0));
+        float mirostat_eta = request.value("mirostat_eta", options.value("mirostat_eta", 0.1));
         float frequency_penalty = request.value("frequency_penalty", 1.1);
         float repetition_penalty = request.value("repeat_penalty", 1.1);
         int length_limit = request.value("max_tokens", 4096);
@@ -440,31 +505,28 @@ void RestHandler::handle_openai_chat_completion(const json& request,
         chat_engine->set_temperature(temperature);
         chat_engine->set_topp(top_p);
         chat_engine->set_topk(top_k);
+        chat_engine->set_seed(seed);
+        chat_engine->set_min_p(min_p);
+        chat_engine->set_typical_p(typical_p);
+        chat_engine->set_mirostat(mirostat, mirostat_tau, mirostat_eta);
         chat_engine->set_frequency_penalty(frequency_penalty);
         chat_engine->set_repetition_penalty(repetition_penalty);
         chat_meta_info meta_info;
+        chat_context_cached = true;
         header_print("FLM", "Start generating...");
         if (stream){
-            // Create a wrapper callback that passes the pre-formatted SSE string directly
-            auto openai_stream_callback = [&send_streaming_response](const std::string& data, bool is_final) {
-                // Create a JSON string to pass through the existing callback interface
-                json data_json = data;
-                send_streaming_response(data_json, is_final);
-            };
-            
-            // Streaming response using streaming_ostream_openai
-            streaming_ostream_openai ostream(model, openai_stream_callback);  // true for chat format
+            // Streaming response using streaming_ostream_openai, the SSE events are passed through as-is
+            streaming_ostream_openai ostream(model, send_streaming_response, parse_stream_coalesce(request, options));
             std::vector<int> prompts = chat_engine->tokenize(messages, true);
-            std::string response_text = chat_engine->generate_with_prompt(meta_info, prompts, length_limit, ostream);
+            std::string response_text = chat_engine->generate_with_prompt(meta_info, prompts, length_limit, ostream, nullptr, make_cancel_check(cancellation_token));
             ostream.finalize(meta_info);
             // auto history = this->chat_engine->get_history();
             // std::cout << "history: " << history.first << std::endl;
-            this->chat_engine->clear_context();
         }
         else {
             std::vector<int> prompts = chat_engine->tokenize(messages, true);
             nullstream nstream;
-            std::string response_text = chat_engine->generate_with_prompt(meta_info, prompts, length_limit, nstream);
+            std::string response_text = chat_engine->generate_with_prompt(meta_info, prompts, length_limit, nstream, nullptr, make_cancel_check(cancellation_token));
             json response = {
                 {"id", "fastflowlm-chat-completion"},
                 {"object", "chat.completion"},
@@ -482,13 +544,15 @@ void RestHandler::handle_openai_chat_completion(const json& request,
                 {"usage", {
                     {"prompt_tokens", meta_info.prompt_tokens},
                     {"completion_tokens", meta_info.generated_tokens},
-                    {"total_tokens", meta_info.prompt_tokens + meta_info.generated_tokens}
+                    {"total_tokens", meta_info.prompt_tokens + meta_info.generated_tokens},
+                    {"prompt_tokens_details", {
+                        {"cached_tokens", meta_info.cached_tokens}
+                    }}
                 }}
             };
             send_response(response);
             // auto history = this->chat_engine->get_history();
             // std::cout << "history: " << history.first << std::endl;
-            this->chat_engine->clear_context();
         }
 
     } catch (const std::exception& e) {
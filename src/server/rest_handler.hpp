@@ -13,6 +13,7 @@
 #include "model_downloader.hpp"
 #include <nlohmann/json.hpp>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <functional>
 
@@ -22,7 +23,7 @@ using json = nlohmann::ordered_json;
 struct CancellationToken;
 
 ///@brief Stream callback type for sending streaming responses
-using StreamResponseCallback = std::function<void(const json&, bool)>; // data, is_final
+using StreamResponseCallback = std::function<void(std::string_view, bool)>; // pre-formatted chunk, is_final
 
 class RestHandler {
 public:
@@ -34,7 +35,8 @@ public:
                         StreamResponseCallback send_streaming_response,
                         std::shared_ptr<CancellationToken> cancellation_token = nullptr);
 
-    void handle_chat(const json& request,
+    void handle_chat(json& request,
+                    const std::vector<std::string_view>& images,
                     std::function<void(const json&)> send_response, 
                     StreamResponseCallback send_streaming_response,
                     std::shared_ptr<CancellationToken> cancellation_token = nullptr);
@@ -79,7 +81,7 @@ public:
                       std::function<void(const json&)> send_response,
                       StreamResponseCallback send_streaming_response);
 
-    void handle_openai_chat_completion(const json& request,
+    void handle_openai_chat_completion(json& request,
                                       std::function<void(const json&)> send_response,
                                       StreamResponseCallback send_streaming_response,
                                       std::shared_ptr<CancellationToken> cancellation_token = nullptr);
@@ -97,4 +99,6 @@ private:
     int generate_context_id;
     int chat_context_id;
     std::string last_question;
+    ///@brief the KV cache holds a chat conversation kept for prefix reuse
+    bool chat_context_cached = false;
 }; 
\ No newline at end of file
@@ -8,11 +8,18 @@
  */
 #include "server.hpp"
 #include "rest_handler.hpp"
+#include "request_reader.hpp"
+#include "utils/metrics.hpp"
+#include "utils/profiler.hpp"
+#include "utils/trace.hpp"
 #include <sstream>
 #include <thread>
 #include <iostream>
 #include <iomanip>
 #include <locale>
+#include <condition_variable>
+#include <set>
+#include <charconv>
 
 
 // Global NPU access control
@@ -21,6 +28,16 @@ std::atomic<bool> g_npu_in_use{false};
 
 std::atomic<int> g_npu_active_requests{0};
 
+// NPU admission queue, guarded by g_npu_access_mutex
+// Waiters are ordered by (-priority, ticket): higher priority first, FIFO within a priority
+static std::condition_variable g_npu_access_cv;
+static std::set<std::pair<int, uint64_t>> g_npu_waiters;
+static uint64_t g_npu_next_ticket = 0;
+// The default depth lets every other connection of the default 5 wait, see WebServer::max_connections_
+static npu_queue_stats g_npu_queue_stats = {0, 4, 0, 0, 0, 0, 0, 0};
+// Distribution of the NPU queue wait of admitted requests, the stats above only keep last/max/total
+static profiler g_npu_queue_wait;
+
 ///@brief get current time string, format: hh:mm:ss mm:dd:yyyy
 ///@return the current time string
 std::string get_current_time_string() {
@@ -32,81 +49,189 @@ std::string get_current_time_string() {
 }
 
 // Helper: Truncate a UTF-8 string by code points, not bytes
-std::string utf8_truncate_middle(const std::string& input, size_t head_count, size_t tail_count) {
-    // Walk the string to count code points
-    size_t codepoints = 0;
-    std::vector<size_t> positions; // positions of codepoint starts
-    for (size_t i = 0; i < input.size();) {
-        positions.push_back(i);
-        unsigned char c = static_cast<unsigned char>(input[i]);
+// Only the head and the tail are walked, so a 20 MB base64 image costs as much as a short string
+std::string utf8_truncate_middle(std::string_view input, size_t head_count, size_t tail_count) {
+    size_t head_end = 0;
+    for (size_t n = 0; n < head_count && head_end < input.size(); ++n) {
+        unsigned char c = static_cast<unsigned char>(input[head_end]);
         size_t char_len = 1;
         if ((c & 0x80) == 0) char_len = 1;
         else if ((c & 0xE0) == 0xC0) char_len = 2;
         else if ((c & 0xF0) == 0xE0) char_len = 3;
         else if ((c & 0xF8) == 0xF0) char_len = 4;
         else char_len = 1; // fallback: treat as single byte
-        i += char_len;
-        codepoints++;
+        head_end = std::min(head_end + char_len, input.size());
+    }
+    size_t tail_start = input.size();
+    for (size_t n = 0; n < tail_count && tail_start > head_end; ++n) {
+        // Step back to the start of the previous code point
+        do {
+            tail_start--;
+        } while (tail_start > head_end && (static_cast<unsigned char>(input[tail_start]) & 0xC0) == 0x80);
     }
-    if (codepoints <= head_count + tail_count) return input;
+    if (tail_start <= head_end) return std::string(input);
     // Get head and tail
-    std::string head = input.substr(0, positions[head_count]);
-    std::string tail = input.substr(positions[codepoints - tail_count]);
-    return head + "..." + tail;
+    std::string result;
+    result.reserve(head_end + 3 + input.size() - tail_start);
+    result.append(input.substr(0, head_end));
+    result.append("...");
+    result.append(input.substr(tail_start));
+    return result;
 }
 
-///@brief brief print request
-///@param request the request
-void brief_print_message_request(nlohmann::json request) {
-    // if request has "messages" or "message" field, the context in meassages shall be printed briefly
-    if (request.contains("messages")) {
-        for (auto& message : request["messages"]) {
-            if (message.contains("content")) {
-                std::string content = message["content"].get<std::string>();
-                if (content.size() > 20) {
-                    message["content"] = utf8_truncate_middle(content, 10, 10);
+///@brief append a size-capped, single-line summary of a JSON value
+///@param out the summary
+///@param value the value, only read
+///@param max_bytes the summary stops growing at this size
+static void summarize_json(std::string& out, const json& value, size_t max_bytes) {
+    switch (value.type()) {
+        case json::value_t::object: {
+            out += '{';
+            bool first = true;
+            for (auto it = value.begin(); it != value.end(); ++it) {
+                if (out.size() >= max_bytes) {
+                    out += "...";
+                    break;
                 }
+                if (!first) out += ", ";
+                first = false;
+                out += '"';
+                out += it.key();
+                out += "\": ";
+                summarize_json(out, it.value(), max_bytes);
             }
-            if (message.contains("images")) {
-                nlohmann::ordered_json::array_t images = message.value("images", nlohmann::ordered_json::array());
-                nlohmann::ordered_json::array_t new_images;
-                for (auto& image : images) {
-                    std::string image_str = image.get<std::string>();
-                    if (image_str.size() > 20) {
-                        new_images.push_back(utf8_truncate_middle(image_str, 10, 10));
-                    } else {
-                        new_images.push_back(image_str);
-                    }
+            out += '}';
+            break;
+        }
+        case json::value_t::array: {
+            out += '[';
+            bool first = true;
+            for (const auto& element : value) {
+                if (out.size() >= max_bytes) {
+                    out += "...";
+                    break;
                 }
-                message["images"] = new_images;
+                if (!first) out += ", ";
+                first = false;
+                summarize_json(out, element, max_bytes);
             }
+            out += ']';
+            break;
         }
-    }
-    if (request.contains("message")){
-        std::string content = request["message"]["content"].get<std::string>();
-        if (content.size() > 20) {
-            request["message"]["content"] = utf8_truncate_middle(content, 10, 10);
+        case json::value_t::string: {
+            // message contents and base64 images are shortened to their first and last code points
+            const std::string& str = value.get_ref<const std::string&>();
+            out += '"';
+            out += str.size() > 20 ? utf8_truncate_middle(str, 10, 10) : str;
+            out += '"';
+            break;
         }
+        default:
+            out += value.dump();
+            break;
     }
-    header_print("LOG", "Body: ");
-    std::cout << request.dump(4) << std::endl;
+}
 
+///@brief brief print request
+///@param request the request
+void brief_print_message_request(const json& request) {
+    std::string summary;
+    summarize_json(summary, request, 4096);
+    header_print("LOG", "Body: " << summary);
 }
 // NPU Access Manager implementation
 bool NPUAccessManager::try_acquire_npu_access() {
     std::lock_guard<std::mutex> lock(g_npu_access_mutex);
-    if (g_npu_in_use.load()) {
-        return false; // NPU is already in use
+    if (g_npu_in_use.load() || !g_npu_waiters.empty()) {
+        return false; // NPU is already in use, or others are queued ahead of us
     }
     g_npu_in_use.store(true);
     g_npu_active_requests.fetch_add(1);
     return true;
 }
 
+///@brief wait in the admission queue for NPU access
+///@param priority higher priority requests are admitted first, FIFO within the same priority
+///@param timeout the maximum time to wait in the queue
+///@param waited_us the time spent in the queue, in microseconds
+///@return NPU_ADMITTED if access is granted, otherwise the reason for rejection
+npu_admission_t NPUAccessManager::acquire_npu_access(int priority, std::chrono::milliseconds timeout, uint64_t& waited_us) {
+    auto enqueue_time = std::chrono::steady_clock::now();
+    waited_us = 0;
+    std::unique_lock<std::mutex> lock(g_npu_access_mutex);
+
+    // Fast path: NPU idle and nobody waiting
+    if (!g_npu_in_use.load() && g_npu_waiters.empty()) {
+        g_npu_in_use.store(true);
+        g_npu_active_requests.fetch_add(1);
+        g_npu_queue_stats.admitted++;
+        g_npu_queue_stats.last_wait_us = 0;
+        g_npu_queue_wait.record_ns(0);
+        return NPU_ADMITTED;
+    }
+
+    if (g_npu_waiters.size() >= g_npu_queue_stats.max_queue_depth) {
+        g_npu_queue_stats.rejected++;
+        return NPU_QUEUE_FULL;
+    }
+
+    const std::pair<int, uint64_t> ticket = {-priority, g_npu_next_ticket++};
+    g_npu_waiters.insert(ticket);
+
+    bool admitted = g_npu_access_cv.wait_until(lock, enqueue_time + timeout, [&ticket]() {
+        return !g_npu_in_use.load() && *g_npu_waiters.begin() == ticket;
+    });
+    g_npu_waiters.erase(ticket);
+    waited_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - enqueue_time).count();
+
+    if (!admitted) {
+        g_npu_queue_stats.timed_out++;
+        // The head of the queue may have changed, let the next waiter re-check
+        g_npu_access_cv.notify_all();
+        return NPU_QUEUE_TIMEOUT;
+    }
+
+    g_npu_in_use.store(true);
+    g_npu_active_requests.fetch_add(1);
+    g_npu_queue_stats.admitted++;
+    g_npu_queue_stats.last_wait_us = waited_us;
+    g_npu_queue_stats.total_wait_us += waited_us;
+    g_npu_queue_stats.max_wait_us = std::max(g_npu_queue_stats.max_wait_us, waited_us);
+    g_npu_queue_wait.record_ns(waited_us * 1000);
+    return NPU_ADMITTED;
+}
+
 void NPUAccessManager::release_npu_access() {
+    {
+        std::lock_guard<std::mutex> lock(g_npu_access_mutex);
+        g_npu_in_use.store(false);
+        g_npu_active_requests.fetch_sub(1);
+    }
+    g_npu_access_cv.notify_all();
+}
+
+void NPUAccessManager::set_max_queue_depth(size_t depth) {
+    std::lock_guard<std::mutex> lock(g_npu_access_mutex);
+    g_npu_queue_stats.max_queue_depth = depth;
+}
+
+///@brief percentile of the NPU queue wait of admitted requests
+///@param percentile the percentile, 0 to 100
+///@return the wait in milliseconds
+double NPUAccessManager::get_queue_wait_percentile_ms(double percentile) {
+    return g_npu_queue_wait.get_histogram().get_percentile_ns(percentile) / 1e6;
+}
+
+size_t NPUAccessManager::get_queue_depth() {
     std::lock_guard<std::mutex> lock(g_npu_access_mutex);
-    g_npu_in_use.store(false);
-    g_npu_active_requests.fetch_sub(1);
+    return g_npu_waiters.size();
+}
+
+npu_queue_stats NPUAccessManager::get_queue_stats() {
+    std::lock_guard<std::mutex> lock(g_npu_access_mutex);
+    npu_queue_stats stats = g_npu_queue_stats;
+    stats.queue_depth = g_npu_waiters.size();
+    return stats;
 }
 
 bool NPUAccessManager::is_npu_available() {
@@ -128,20 +253,36 @@ bool requires_npu_access(const std::string& method, const std::string& path) {
     return false;
 }
 
+// Helper function to check if an endpoint runs on the inference executor instead of an I/O thread
+bool runs_on_inference_executor(const std::string& method, const std::string& path) {
+    // Anything that may run for seconds; light endpoints stay on the I/O threads
+    return requires_npu_access(method, path) || (method == "POST" && path == "/api/pull");
+}
+
+///@brief cancellation check, also true once the client disconnected
+bool CancellationToken::cancelled() const {
+    if (is_cancelled.load()) {
+        return true;
+    }
+    return session && !session->is_client_connected();
+}
+
 ///@brief HttpSession class implementation
 ///@param socket the socket
 ///@param server the server
 HttpSession::HttpSession(tcp::socket socket, WebServer& server)
     : socket_(std::move(socket))
     , server_(server)
-    , is_streaming_(false) {
+    , is_streaming_(false)
+    , is_deferred_(false)
+    , watch_timer_(socket_.get_executor()) {
     // Set socket timeout
     socket_.set_option(tcp::socket::keep_alive(false));
     // Avoid abortive close that can lead to client-side broken pipe on large uploads
     socket_.set_option(tcp::socket::linger(false, 0));
     
     // Debug: Log TCP connection formation
-    header_print("🔗 ", "TCP connection established - Remote: " + socket_.remote_endpoint().address().to_string() + ":" + std::to_string(socket_.remote_endpoint().port()));
+    header_print_debug("🔗 ", "TCP connection established - Remote: " + socket_.remote_endpoint().address().to_string() + ":" + std::to_string(socket_.remote_endpoint().port()));
 }
 
 ///@brief start
@@ -155,14 +296,88 @@ void HttpSession::close_connection() {
     
     // Debug: Log TCP connection disconnection
     try {
-        header_print("🔒 ", "TCP connection closing - Remote: " + socket_.remote_endpoint().address().to_string() + ":" + std::to_string(socket_.remote_endpoint().port()));
+        header_print_debug("🔒 ", "TCP connection closing - Remote: " + socket_.remote_endpoint().address().to_string() + ":" + std::to_string(socket_.remote_endpoint().port()));
     } catch (const std::exception& e) {
-        header_print("🔒 ", "TCP connection closing - Remote endpoint unavailable");
+        header_print_debug("🔒 ", "TCP connection closing - Remote endpoint unavailable");
     }
     socket_.shutdown(tcp::socket::shutdown_both, ec);
     server_.active_connections_.fetch_sub(1);
 }
 
+///@brief is client connected
+///@return false if a write failed or the disconnect probe saw the peer close its end
+///@note Only reads a flag, the socket itself is touched on the session strand alone
+bool HttpSession::is_client_connected() {
+    return !client_closed_.load();
+}
+
+///@brief defer response
+///@note Called on the session strand before the request is handed to the inference executor
+void HttpSession::defer_response() {
+    is_deferred_ = true;
+    watch_client();
+}
+
+///@brief post response
+///@param status the status
+///@param body the body
+///@param retry_later add a Retry-After header
+void HttpSession::post_response(http::status status, std::string body, bool retry_later) {
+    auto self = shared_from_this();
+    net::post(socket_.get_executor(), [self, status, body = std::move(body), retry_later]() mutable {
+        self->res_.result(status);
+        self->res_.body() = std::move(body);
+        self->res_.set(http::field::content_type, "application/json");
+        if (retry_later) {
+            self->res_.set(http::field::retry_after, "1");
+        }
+        self->res_.prepare_payload();
+        self->write_response();
+    });
+}
+
+///@brief watch client
+void HttpSession::watch_client() {
+    auto self = shared_from_this();
+    watch_timer_.expires_after(std::chrono::milliseconds(50));
+    watch_timer_.async_wait([self](beast::error_code ec) {
+        if (ec || !self->is_deferred_) {
+            return;
+        }
+        self->probe_client();
+        if (!self->client_closed_.load()) {
+            self->watch_client();
+        }
+    });
+}
+
+///@brief probe client
+///@note Peeks the socket without blocking, pending request bytes are left in place
+void HttpSession::probe_client() {
+    boost::system::error_code ec;
+    char probe;
+    socket_.non_blocking(true, ec);
+    socket_.receive(net::buffer(&probe, 1), tcp::socket::message_peek, ec);
+    boost::system::error_code ignored;
+    socket_.non_blocking(false, ignored);
+    if (ec == net::error::would_block || ec == net::error::try_again || !ec) {
+        return;
+    }
+    // eof, connection_reset, ... the client is gone
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        client_closed_.store(true);
+    }
+    // Wake a producer held by backpressure
+    write_cv_.notify_all();
+}
+
+///@brief stop watching client
+void HttpSession::stop_watching_client() {
+    is_deferred_ = false;
+    watch_timer_.cancel();
+}
+
 ///@brief read request
 void HttpSession::read_request() {
     auto self = shared_from_this();
@@ -174,9 +389,10 @@ void HttpSession::read_request() {
     http::async_read(self->socket_, self->buffer_, *parser,
         [self, parser](beast::error_code ec, std::size_t bytes_transferred) {
             if (!ec) {
-                header_print("TCP", "Read " + std::to_string(bytes_transferred) + " bytes from socket");
+                header_print_debug("TCP", "Read " + std::to_string(bytes_transferred) + " bytes from socket");
                 // Move the parsed message into our request object
                 self->req_ = parser->release();
+                self->request_received_at_ = std::chrono::steady_clock::now();
                 self->handle_request();
                 return;
             }
@@ -197,9 +413,9 @@ void HttpSession::read_request() {
 
             // Connection closed or other error, decrement connection counter
             try {
-                header_print("🔒 ", "TCP connection closed - Remote: " + self->socket_.remote_endpoint().address().to_string() + ":" + std::to_string(self->socket_.remote_endpoint().port()));
+                header_print_debug("🔒 ", "TCP connection closed - Remote: " + self->socket_.remote_endpoint().address().to_string() + ":" + std::to_string(self->socket_.remote_endpoint().port()));
             } catch (...) {
-                header_print("🔒 ", "TCP connection closed - Remote endpoint unavailable");
+                header_print_debug("🔒 ", "TCP connection closed - Remote endpoint unavailable");
             }
             self->server_.active_connections_.fetch_sub(1);
         });
@@ -211,7 +427,13 @@ void HttpSession::handle_request() {
     res_ = {};
     res_.version(req_.version());
     res_.keep_alive(req_.keep_alive());
-    
+    is_streaming_ = false;
+    is_deferred_ = false;
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        stream_headers_queued_ = false;
+        stream_final_queued_ = false;
+    }
     
     // Handle the request through the server
     server_.handle_request(req_, res_, socket_, shared_from_this());
@@ -219,10 +441,10 @@ void HttpSession::handle_request() {
     // Clear the buffer after processing to prevent data accumulation
     buffer_.consume(buffer_.size());
     
-    if (!is_streaming_) {
+    if (!is_streaming_ && !is_deferred_) {
         write_response();
     } else {
-        // For streaming responses, we need to handle connection cleanup differently
+        // Deferred and streaming responses are written when the inference executor posts them back
         // The connection will be closed when streaming ends
     }
 }
@@ -230,36 +452,31 @@ void HttpSession::handle_request() {
 ///@brief write response
 void HttpSession::write_response() {
     auto self = shared_from_this();
+    stop_watching_client();
 
     header_print("⬆️ ", "Outgoing Response: ");
     header_print("LOG", "Time stamp: " << get_current_time_string()); // hh:mm:ss mm:dd:yyyy
     
     // Check if this is one of the endpoints where we should skip printing the response body
     std::string target = std::string(req_.target());
-    bool skip_body_print = (target == "/api/ps" || target == "/api/tags" || target == "/api/version");
+    bool skip_body_print = (target == "/api/ps" || target == "/api/tags" || target == "/api/version" || target == "/metrics");
     
     if (!skip_body_print) {
-        try{
-            nlohmann::json response_json = json::parse(res_.body());
-            brief_print_message_request(response_json);
-            // std::cout << "response_json: " << response_json.dump(4) << std::endl;
-        } catch (const std::exception& e) {
-            header_print("LOG", "Body: ");
-            std::cout << res_.body() << std::endl;
-        }
+        // Print the serialized body directly instead of parsing it back
+        header_print("LOG", "Body: " << utf8_truncate_middle(res_.body(), 256, 256));
     }
 
-    std::cout << "================================================" << std::endl;
+    log_line(LOG_LEVEL_INFO, "================================================");
 
     http::async_write(socket_, res_,
         [self](beast::error_code ec, std::size_t) {
             if (!self->req_.keep_alive()) {
-                header_print("🔒  ", "Closing TCP connection (non-keep-alive)");
+                header_print_debug("🔒  ", "Closing TCP connection (non-keep-alive)");
                 self->socket_.shutdown(tcp::socket::shutdown_both, ec);
                 // Decrement connection counter for non-keep-alive connections
                 self->server_.active_connections_.fetch_sub(1);
             } else {
-                header_print("TCP", "Keeping TCP connection alive for next request");
+                header_print_debug("TCP", "Keeping TCP connection alive for next request");
                 // Clear the request object before reading the next request
                 self->req_ = {};
                 // For keep-alive connections, read the next request
@@ -268,89 +485,131 @@ void HttpSession::write_response() {
         });
 }
 
+///@brief append one HTTP chunk: size in hex + \r\n + data + \r\n
+///@param out the buffer to append to
+///@param content the chunk content
+static void append_http_chunk(std::string& out, std::string_view content) {
+    char size_hex[16];
+    auto result = std::to_chars(size_hex, size_hex + sizeof(size_hex), content.size(), 16);
+    out.append(size_hex, result.ptr);
+    out.append("\r\n");
+    out.append(content);
+    out.append("\r\n");
+}
+
+// A producer that gets this far ahead of the client waits for the in-flight write to finish
+static const size_t g_stream_backpressure_bytes = 1024 * 1024;
+
 ///@brief write streaming response
-///@param data the data
+///@param chunk the pre-formatted chunk, an NDJSON line or SSE event
 ///@param is_final the is final
-void HttpSession::write_streaming_response(const json& data, bool is_final) {
-    if (!is_streaming_) {
-        // Initialize streaming response headers
-        is_streaming_ = true;
-        res_.result(http::status::ok);
-        res_.set(http::field::content_type, "application/x-ndjson");
-        res_.set(http::field::cache_control, "no-cache");
-        res_.set(http::field::connection, "keep-alive");
-        res_.set(http::field::transfer_encoding, "chunked");
-        
-        // Send headers immediately using raw socket write
-        std::string headers = "HTTP/1.1 200 OK\r\n";
-        headers += "Content-Type: application/x-ndjson\r\n";
-        headers += "Cache-Control: no-cache\r\n";
-        headers += "Connection: keep-alive\r\n";
-        headers += "Transfer-Encoding: chunked\r\n";
-        headers += "\r\n";
-        
-        // Send headers synchronously
-        boost::system::error_code ec;
-        net::write(socket_, net::buffer(headers), ec);
-        if (ec) return;
+void HttpSession::write_streaming_response(std::string_view chunk, bool is_final) {
+    bool schedule = false;
+    {
+        std::unique_lock<std::mutex> lock(write_mutex_);
+        write_cv_.wait(lock, [this]() {
+            return pending_writes_.size() < g_stream_backpressure_bytes || client_closed_.load();
+        });
+        if (!stream_headers_queued_) {
+            stream_headers_queued_ = true;
+            pending_writes_.append("HTTP/1.1 200 OK\r\n"
+                                   "Content-Type: application/x-ndjson\r\n"
+                                   "Cache-Control: no-cache\r\n"
+                                   "Connection: keep-alive\r\n"
+                                   "Transfer-Encoding: chunked\r\n"
+                                   "\r\n");
+        }
+        if (!client_closed_.load()) {
+            append_http_chunk(pending_writes_, chunk);
+            if (is_final) {
+                // 0-length chunk to end stream
+                pending_writes_.append("0\r\n\r\n");
+            }
+        }
+        if (is_final) {
+            stream_final_queued_ = true;
+        }
+        if (!write_in_flight_ && !write_scheduled_) {
+            write_scheduled_ = true;
+            schedule = true;
+        }
+    }
+
+    if (schedule) {
+        auto self = shared_from_this();
+        net::post(socket_.get_executor(), [self]() {
+            self->flush_stream_writes();
+        });
     }
-    
-    // Send this chunk immediately
-    send_chunk_data(data, is_final);
 }
 
-///@brief send chunk data
-///@param data the data
-///@param is_final the is final
-void HttpSession::send_chunk_data(const json& data, bool is_final) {
-    std::string chunk_content;
-    
-    // Check if the data is a string (pre-formatted SSE with "data: " prefix)
-    if (data.is_string()) {
-        std::string data_str = data.get<std::string>();
-        // If it starts with "data: ", it's already formatted for SSE
-        if (data_str.substr(0, 6) == "data: ") {
-            chunk_content = data_str;
-        } else {
-            // Regular JSON string, add single newline for Ollama format
-            chunk_content = data_str;
+///@brief flush stream writes
+void HttpSession::flush_stream_writes() {
+    bool start_write = false;
+    bool finish = false;
+    {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        write_scheduled_ = false;
+        if (write_in_flight_) {
+            // The completion handler flushes again
+            return;
+        }
+        if (client_closed_.load()) {
+            pending_writes_.clear();
+        }
+        if (!pending_writes_.empty()) {
+            std::swap(pending_writes_, inflight_writes_);
+            write_in_flight_ = true;
+            start_write = true;
+        } else if (stream_final_queued_) {
+            stream_final_queued_ = false;
+            finish = true;
         }
-    } else {
-        // Regular JSON object, format for Ollama compatibility
-        chunk_content = data.dump() + "\n";
     }
-    
-    // std::cout << "Chunk: " << chunk_content;
-    
-    // HTTP chunked format: size in hex + \r\n + data + \r\n
-    std::ostringstream chunk_size;
-    chunk_size << std::hex << chunk_content.length();
-    
-    std::string http_chunk = chunk_size.str() + "\r\n" + chunk_content + "\r\n";
-    
-    // Send chunk immediately
+    write_cv_.notify_all();
+
+    if (finish) {
+        finish_stream();
+        return;
+    }
+    if (!start_write) {
+        return;
+    }
+
+    is_streaming_ = true;
+    auto self = shared_from_this();
+    net::async_write(socket_, net::buffer(inflight_writes_),
+        [self](beast::error_code ec, std::size_t) {
+            {
+                std::lock_guard<std::mutex> lock(self->write_mutex_);
+                self->write_in_flight_ = false;
+                self->inflight_writes_.clear();
+                if (ec) {
+                    self->client_closed_.store(true);
+                }
+            }
+            self->write_cv_.notify_all();
+            self->flush_stream_writes();
+        });
+}
+
+///@brief finish stream
+void HttpSession::finish_stream() {
+    stop_watching_client();
     boost::system::error_code ec;
-    net::write(socket_, net::buffer(http_chunk), ec);
-    
-    if (is_final) {
-        // Send final chunk (0-length chunk to end stream)
-        std::string final_chunk = "0\r\n\r\n";
-        net::write(socket_, net::buffer(final_chunk), ec);
-        
-        if (!req_.keep_alive()) {
-            header_print("🔒 ", "Closing TCP connection (streaming, non-keep-alive)");
-            socket_.shutdown(tcp::socket::shutdown_both, ec);
-            // Decrement connection counter for non-keep-alive connections
-            server_.active_connections_.fetch_sub(1);
-        } else {
-            header_print("🔗 ", "Keeping TCP connection alive for next request (streaming)");
-            // Clear the buffer before reading the next request
-            buffer_.consume(buffer_.size());
-            // Clear the request object before reading the next request
-            req_ = {};
-            // For keep-alive connections, read the next request
-            read_request();
-        }
+    if (!req_.keep_alive() || client_closed_.load()) {
+        header_print_debug("🔒 ", "Closing TCP connection (streaming, non-keep-alive)");
+        socket_.shutdown(tcp::socket::shutdown_both, ec);
+        // Decrement connection counter for non-keep-alive connections
+        server_.active_connections_.fetch_sub(1);
+    } else {
+        header_print_debug("🔗 ", "Keeping TCP connection alive for next request (streaming)");
+        // Clear the buffer before reading the next request
+        buffer_.consume(buffer_.size());
+        // Clear the request object before reading the next request
+        req_ = {};
+        // For keep-alive connections, read the next request
+        read_request();
     }
 }
 
@@ -366,6 +625,7 @@ WebServer::~WebServer() {
 ///@brief start
 void WebServer::start() {
     running = true;
+    inference_executor_.start(inference_thread_count_);
     do_accept();
     
     // Run the I/O service on multiple threads for better concurrency
@@ -379,7 +639,7 @@ void WebServer::start() {
         });
     }
     
-    header_print("LOG", "WebServer started on port " + std::to_string(port) + " with " + std::to_string(io_thread_count_) + " I/O threads");
+    header_print("LOG", "WebServer started on port " + std::to_string(port) + " with " + std::to_string(io_thread_count_) + " I/O threads and " + std::to_string(inference_thread_count_) + " inference workers");
 }
 
 ///@brief stop
@@ -394,6 +654,15 @@ void WebServer::stop() {
         }
     }
     io_threads_.clear();
+
+    // Stop running generations, then wait for the inference workers
+    {
+        std::lock_guard<std::mutex> lock(active_requests_mutex_);
+        for (auto& request : active_requests_) {
+            request.second->cancel();
+        }
+    }
+    inference_executor_.stop();
 }
 
 ///@brief register active request
@@ -436,7 +705,8 @@ void WebServer::register_handler(const std::string& method, const std::string& p
 
 ///@brief do accept
 void WebServer::do_accept() {
-    acceptor.async_accept(
+    // Each connection gets its own strand, results from the inference executor are posted to it
+    acceptor.async_accept(net::make_strand(ioc),
         [this](beast::error_code ec, tcp::socket socket) {
             if (!ec) {
                 // Check connection limit
@@ -468,116 +738,296 @@ void WebServer::handle_request(http::request<http::string_body>& req,
                               http::response<http::string_body>& res,
                               tcp::socket& socket,
                               std::shared_ptr<HttpSession> session) {
+    // Prometheus scrapes are plain text and frequent, answer them before the request is logged
+    if (req.method() == http::verb::get && req.target() == "/metrics") {
+        res.result(http::status::ok);
+        res.body() = render_metrics();
+        res.set(http::field::content_type, "text/plain; version=0.0.4; charset=utf-8");
+        res.prepare_payload();
+        return;
+    }
+    // The recorded trace spans as Chrome trace JSON, exported spans are cleared
+    if (req.method() == http::verb::get && req.target() == "/debug/trace") {
+        res.result(http::status::ok);
+        trace_dump(res.body());
+        res.set(http::field::content_type, "application/json");
+        res.prepare_payload();
+        return;
+    }
+    g_metrics.requests_total.fetch_add(1, std::memory_order_relaxed);
+    // Spans of this request are tagged with its trace id, executor routes hand it to the worker
+    trace_request_scope trace_scope(trace_enabled() ? trace_new_request() : 0, true);
+
     // Log request details
-    std::cout << "================================================" << std::endl;
+    log_line(LOG_LEVEL_INFO, "================================================");
     header_print("⬇️ ", "Incoming Request: " << req.method_string());
     header_print("LOG", "Time stamp: " << get_current_time_string()); // hh:mm:ss mm:dd:yyyy
     header_print("LOG", "Target: " << req.target());
     header_print("LOG", "Version: " << req.version());
     header_print("LOG", "Keep-Alive: " << req.keep_alive());
+    // The body is parsed exactly once, the document is moved into the handler
+    // Base64 images stay in the body and are handed over as views, see parse_request_body
     json request_json;
+    std::vector<std::string_view> images;
+    bool invalid_json = false;
     try {
+        TRACE_SPAN_CAT("http.parse", "server");
         if (!req.body().empty()) {
-            request_json = json::parse(req.body());
+            parse_request_body(req.body(), request_json, images);
         }
     } catch (const std::exception& e) {
+        invalid_json = true;
         header_print("LOG", "Error parsing request body: " + std::string(e.what()));
     }
+    if (!invalid_json && images.empty()) {
+        // Handlers only see the document, do not hold the raw body next to it
+        std::string().swap(req.body());
+    }
     brief_print_message_request(request_json);
-    // std::cout << "request_json: " << request_json.dump(4) << std::endl;
+    if (!images.empty()) {
+        header_print("LOG", "Images: " << images.size() << " left in the request body");
+    }
     
     std::string key = std::string(req.method_string()) + " " + std::string(req.target());
 
     auto it = routes.find(key);
     if (it != routes.end()) {
-        // Check if this endpoint requires NPU access
-        bool needs_npu = requires_npu_access(std::string(req.method_string()), std::string(req.target()));
-        
-        if (needs_npu) {
-            // Try to acquire NPU access using the shared manager
-            if (!NPUAccessManager::try_acquire_npu_access()) {
-                // NPU is currently in use by another request
-                res.result(http::status::service_unavailable);
-                res.body() = json{{"error", "NPU is currently in use by another request. Please try again later."}}.dump();
+        if (invalid_json) {
+            res.result(http::status::bad_request);
+            res.body() = json{{"error", "Invalid JSON"}}.dump();
+            res.set(http::field::content_type, "application/json");
+            res.prepare_payload();
+            return;
+        }
+
+        // Long-running endpoints go to the inference executor so the I/O threads stay responsive
+        if (runs_on_inference_executor(std::string(req.method_string()), std::string(req.target()))) {
+            bool needs_npu = requires_npu_access(std::string(req.method_string()), std::string(req.target()));
+            session->defer_response();
+            trace_scope.hand_off();
+            dispatch_to_executor(it->second, req, std::move(request_json), std::move(images), session, needs_npu);
+            return;
+        }
+
+        // Light endpoints run inline on the I/O thread; they must not stream
+        invoke_handler(it->second, req, request_json, images, session, false,
+            [&res](http::status status, const json& response_data) {
+                res.result(status);
+                res.body() = response_data.dump();
                 res.set(http::field::content_type, "application/json");
-                res.prepare_payload();
-                header_print("🚫 ", "NPU access denied for request: " + key);
+            });
+    } else {
+        res.result(http::status::not_found);
+        res.body() = json{{"error", "Not Found"}}.dump();
+        res.set(http::field::content_type, "application/json");
+    }
+    
+    res.prepare_payload();
+}
+
+///@brief dispatch to executor
+///@param handler the handler
+///@param req the request, owned by the session until its response is written
+///@param request_json the parsed request body
+///@param images the base64 images, views into the request body
+///@param session the session
+///@param needs_npu whether the request has to wait in the NPU admission queue
+void WebServer::dispatch_to_executor(const RequestHandler& handler,
+                                     const http::request<http::string_body>& req,
+                                     json request_json,
+                                     std::vector<std::string_view> images,
+                                     std::shared_ptr<HttpSession> session,
+                                     bool needs_npu) {
+    std::string key = std::string(req.method_string()) + " " + std::string(req.target());
+    uint64_t trace_request = trace_current_request();
+    inference_executor_.submit([this, handler, &req, request_json = std::move(request_json), images = std::move(images), session, needs_npu, key, trace_request]() mutable {
+        trace_request_scope trace_scope(trace_request, true);
+        if (needs_npu) {
+            // Wait in the admission queue; clients may set "priority" and "queue_timeout_ms"
+            int priority = 0;
+            std::chrono::milliseconds queue_timeout = npu_queue_timeout_;
+            if (request_json.is_object()) {
+                auto priority_it = request_json.find("priority");
+                auto timeout_it = request_json.find("queue_timeout_ms");
+                if ((priority_it != request_json.end() && !priority_it->is_number_integer())
+                    || (timeout_it != request_json.end() && !timeout_it->is_number_integer())) {
+                    json error = {{"error", "\"priority\" and \"queue_timeout_ms\" must be integers"}};
+                    session->post_response(http::status::bad_request, error.dump());
+                    return;
+                }
+                if (priority_it != request_json.end()) {
+                    priority = priority_it->get<int>();
+                }
+                if (timeout_it != request_json.end()) {
+                    queue_timeout = std::chrono::milliseconds(std::max<int64_t>(timeout_it->get<int64_t>(), 0));
+                }
+            }
+            size_t queue_depth = NPUAccessManager::get_queue_depth();
+            if (queue_depth > 0 || !NPUAccessManager::is_npu_available()) {
+                header_print("⏳ ", "NPU busy, queueing request: " + key + " (queue depth: " + std::to_string(queue_depth) + ", priority: " + std::to_string(priority) + ")");
+            }
+            uint64_t waited_us = 0;
+            npu_admission_t admission;
+            {
+                TRACE_SPAN_CAT("npu.queue_wait", "server");
+                admission = NPUAccessManager::acquire_npu_access(priority, queue_timeout, waited_us);
+            }
+            if (admission != NPU_ADMITTED) {
+                bool queue_full = admission == NPU_QUEUE_FULL;
+                json error = {
+                    {"error", queue_full ? "NPU request queue is full. Please try again later."
+                                         : "Timed out waiting for the NPU. Please try again later."},
+                    {"queue_depth", NPUAccessManager::get_queue_depth()},
+                    {"queue_wait_ms", waited_us / 1000}
+                };
+                session->post_response(http::status::service_unavailable, error.dump(), true);
+                header_print("🚫 ", "NPU access denied for request: " + key + (queue_full ? " (queue full)" : " (queue timeout)"));
                 return;
             }
-            
-            header_print("🟢 ", "NPU access granted for request: " + key);
+
+            g_metrics.queue_wait_seconds.observe(waited_us * 1e-6);
+            header_print("🟢 ", "NPU access granted for request: " + key + " after " + std::to_string(waited_us / 1000) + " ms in queue");
         }
-        
-        // Parse JSON request body
-        json request_json;
+
+        // invoke_handler answers and releases the NPU on every path once it is running,
+        // this only catches a failure before it takes over
         try {
-            if (!req.body().empty()) {
-                request_json = json::parse(req.body());
-            }
+            invoke_handler(handler, req, request_json, images, session, needs_npu,
+                [session](http::status status, const json& response_data) {
+                    session->post_response(status, response_data.dump());
+                });
         } catch (const std::exception& e) {
-            res.result(http::status::bad_request);
-            res.body() = json{{"error", "Invalid JSON"}}.dump();
-            res.set(http::field::content_type, "application/json");
-            res.prepare_payload();
+            header_print("ERROR", "Failed to start request " + key + ": " + e.what());
+            if (needs_npu) {
+                NPUAccessManager::release_npu_access();
+            }
+            session->post_response(http::status::internal_server_error, json{{"error", e.what()}}.dump());
+        }
+    });
+}
+
+///@brief invoke handler
+///@param handler the handler
+///@param req the request
+///@param request_json the parsed request body
+///@param images the base64 images, views into the request body
+///@param session the session
+///@param needs_npu whether NPU access was acquired for this request
+///@param reply writes a complete, non-streaming response
+void WebServer::invoke_handler(const RequestHandler& handler,
+                               const http::request<http::string_body>& req,
+                               json& request_json,
+                               const std::vector<std::string_view>& images,
+                               std::shared_ptr<HttpSession> session,
+                               bool needs_npu,
+                               std::function<void(http::status, const json&)> reply) {
+    // Set while the request holds the NPU, so every exit path releases it exactly once
+    auto npu_held = std::make_shared<std::atomic<bool>>(needs_npu);
+    auto release_npu = [npu_held](const std::string& what) {
+        if (npu_held->exchange(false)) {
+            NPUAccessManager::release_npu_access();
+            header_print("🔵 ", "NPU access released for " + what);
+        }
+    };
+
+    // Extract request_id for tracking (generate one if not provided)
+    std::string request_id;
+    auto request_id_it = request_json.find("request_id");
+    if (request_id_it != request_json.end()) {
+        if (!request_id_it->is_string()) {
+            release_npu("rejected request");
+            try {
+                reply(http::status::bad_request, json{{"error", "\"request_id\" must be a string"}});
+            } catch (const std::exception& reply_error) {
+                header_print("ERROR", "Failed to answer request: " + std::string(reply_error.what()));
+            }
             return;
         }
+        request_id = request_id_it->get<std::string>();
+    } else {
+        // Generate a unique request ID
+        static std::atomic<int> counter{0};
+        request_id = "req_" + std::to_string(counter.fetch_add(1));
+    }
+
+    // Set once the response is started / complete, so a throwing handler is answered exactly once
+    auto streaming = std::make_shared<std::atomic<bool>>(false);
+    auto finished = std::make_shared<std::atomic<bool>>(false);
+    
+    // Create response callback that unregisters the request when done
+    auto send_response = [reply, this, request_id, release_npu, finished](const json& response_data) {
+        reply(http::status::ok, response_data);
+        finished->store(true);
+        unregister_active_request(request_id);
         
-        // Create cancellation token for this request
-        auto cancellation_token = std::make_shared<CancellationToken>(session);
-        
-        // Extract request_id for tracking (generate one if not provided)
-        std::string request_id;
-        if (request_json.contains("request_id")) {
-            request_id = request_json["request_id"];
-        } else {
-            // Generate a unique request ID
-            static std::atomic<int> counter{0};
-            request_id = "req_" + std::to_string(counter.fetch_add(1));
+        // Release NPU access if this was an NPU-intensive request
+        release_npu("request: " + request_id);
+    };
+    
+    // Create streaming response callback that uses the session
+    auto send_streaming_response = [session, this, request_id, needs_npu, release_npu, streaming, finished](std::string_view chunk, bool is_final) {
+        if (!streaming->exchange(true) && needs_npu && session) {
+            // Time to first token as the client sees it, including the NPU queue and prefill
+            std::chrono::duration<double> ttft = std::chrono::steady_clock::now() - session->request_received_at();
+            g_metrics.ttft_seconds.observe(ttft.count());
         }
-        
-        // Register the request for potential cancellation
-        register_active_request(request_id, cancellation_token);
-        
-        // Create response callback that unregisters the request when done
-        auto send_response = [&res, this, request_id, needs_npu](const json& response_data) {
-            res.result(http::status::ok);
-            res.body() = response_data.dump();
-            res.set(http::field::content_type, "application/json");
-            res.prepare_payload();
+        if (session) {
+            session->write_streaming_response(chunk, is_final);
+        }
+        if (is_final) {
+            finished->store(true);
             unregister_active_request(request_id);
             
             // Release NPU access if this was an NPU-intensive request
-            if (needs_npu) {
-                NPUAccessManager::release_npu_access();
-                header_print("🔵 ", "NPU access released for request: " + request_id);
-            }
-        };
-        
-        // Create streaming response callback that uses the session
-        auto send_streaming_response = [session, this, request_id, needs_npu](const json& data, bool is_final) {
-            if (session) {
-                session->write_streaming_response(data, is_final);
-            }
-            if (is_final) {
-                unregister_active_request(request_id);
-                
-                // Release NPU access if this was an NPU-intensive request
-                if (needs_npu) {
-                    NPUAccessManager::release_npu_access();
-                    header_print("🔵 ", "NPU access released for streaming request: " + request_id);
+            release_npu("streaming request: " + request_id);
+        }
+    };
+    
+    // Everything from here on runs with the NPU held, a failure anywhere still answers and releases it
+    try {
+        // Register the request for potential cancellation
+        auto cancellation_token = std::make_shared<CancellationToken>(session);
+        register_active_request(request_id, cancellation_token);
+
+        // Call the handler with the session and cancellation token
+        TRACE_SPAN_CAT("handler", "server");
+        handler(req, request_json, images, send_response, send_streaming_response, session, cancellation_token);
+    } catch (const std::exception& e) {
+        header_print("ERROR", "Error in request handler: " + std::string(e.what()));
+        if (!finished->exchange(true)) {
+            unregister_active_request(request_id);
+            release_npu("failed request: " + request_id);
+            try {
+                if (streaming->load() && session) {
+                    // Headers are already out, end the stream with the error instead
+                    session->write_streaming_response(json{{"error", e.what()}, {"done", true}}.dump() + "\n", true);
+                } else {
+                    reply(http::status::internal_server_error, json{{"error", e.what()}});
                 }
+            } catch (const std::exception& reply_error) {
+                header_print("ERROR", "Failed to answer request " + request_id + ": " + reply_error.what());
             }
-        };
-        
-        // Call the handler with the session and cancellation token
-        it->second(req, send_response, send_streaming_response, session, cancellation_token);
-    } else {
-        res.result(http::status::not_found);
-        res.body() = json{{"error", "Not Found"}}.dump();
-        res.set(http::field::content_type, "application/json");
+        }
     }
-    
-    res.prepare_payload();
+}
+
+///@brief render the serving metrics in the Prometheus text format
+///@return the metrics
+std::string WebServer::render_metrics() const {
+    std::string out;
+    out.reserve(8 * 1024);
+    metrics_render(out);
+    metrics_render_gauge(out, "flm_active_connections", "Open client connections.", (double)get_active_connections());
+    metrics_render_gauge(out, "flm_active_requests", "Requests being handled.", (double)get_active_requests());
+    metrics_render_gauge(out, "flm_inference_pending", "Requests waiting for an inference worker.", (double)inference_executor_.pending());
+    npu_queue_stats stats = NPUAccessManager::get_queue_stats();
+    metrics_render_gauge(out, "flm_npu_queue_depth", "Requests waiting for the NPU.", (double)stats.queue_depth);
+    metrics_render_gauge(out, "flm_npu_in_use", "1 if a request holds the NPU.", NPUAccessManager::is_npu_available() ? 0.0 : 1.0);
+    metrics_render_counter(out, "flm_npu_admitted_total", "Requests admitted to the NPU.", stats.admitted);
+    metrics_render_counter(out, "flm_npu_rejected_total", "Requests rejected because the NPU queue was full.", stats.rejected);
+    metrics_render_counter(out, "flm_npu_timed_out_total", "Requests that gave up waiting for the NPU.", stats.timed_out);
+    metrics_render_counter(out, "flm_log_dropped_lines_total", "Log lines dropped because the log buffer was full.", log_dropped_lines());
+    return out;
 }
 
 ///@brief create lm server
@@ -593,83 +1043,96 @@ std::unique_ptr<WebServer> create_lm_server(model_list& models, ModelDownloader&
     // Register Ollama-compatible routes
     server->register_handler("POST", "/api/generate", 
         [rest_handler](const http::request<http::string_body>& req, 
+                      json& request_json,
+                      const std::vector<std::string_view>& images,
                       std::function<void(const json&)> send_response,
-                      std::function<void(const json&, bool)> send_streaming_response,
+                      StreamChunkCallback send_streaming_response,
                       std::shared_ptr<HttpSession> session,
                       std::shared_ptr<CancellationToken> cancellation_token) {
-            json request_json;
-            if (!req.body().empty()) {
-                request_json = json::parse(req.body());
-            }
             rest_handler->handle_generate(request_json, send_response, send_streaming_response, cancellation_token);
         });
     
     server->register_handler("POST", "/api/chat",
         [rest_handler](const http::request<http::string_body>& req,
+                      json& request_json,
+                      const std::vector<std::string_view>& images,
                       std::function<void(const json&)> send_response,
-                      std::function<void(const json&, bool)> send_streaming_response,
+                      StreamChunkCallback send_streaming_response,
                       std::shared_ptr<HttpSession> session,
                       std::shared_ptr<CancellationToken> cancellation_token) {
-            json request_json;
-            if (!req.body().empty()) {
-                request_json = json::parse(req.body());
-            }
-            rest_handler->handle_chat(request_json, send_response, send_streaming_response, cancellation_token);
+            rest_handler->handle_chat(request_json, images, send_response, send_streaming_response, cancellation_token);
         });
 
     server->register_handler("GET", "/api/ps",
         [rest_handler](const http::request<http::string_body>& req,
+                      json& request_json,
+                      const std::vector<std::string_view>& images,
                       std::function<void(const json&)> send_response,
-                      std::function<void(const json&, bool)> send_streaming_response,
+                      StreamChunkCallback send_streaming_response,
                       std::shared_ptr<HttpSession> session,
                       std::shared_ptr<CancellationToken> cancellation_token) {
-            json request_json;
             rest_handler->handle_ps(request_json, send_response, send_streaming_response);
         });
 
     server->register_handler("POST", "/api/embeddings",
         [rest_handler](const http::request<http::string_body>& req,
+                      json& request_json,
+                      const std::vector<std::string_view>& images,
                       std::function<void(const json&)> send_response,
-                      std::function<void(const json&, bool)> send_streaming_response,
+                      StreamChunkCallback send_streaming_response,
                       std::shared_ptr<HttpSession> session,
                       std::shared_ptr<CancellationToken> cancellation_token) {
-            json request_json;
-            if (!req.body().empty()) {
-                request_json = json::parse(req.body());
-            }
             rest_handler->handle_embeddings(request_json, send_response, send_streaming_response);
         });
     
     server->register_handler("GET", "/api/tags",
         [rest_handler](const http::request<http::string_body>& req,
+                      json& request_json,
+                      const std::vector<std::string_view>& images,
                       std::function<void(const json&)> send_response,
-                      std::function<void(const json&, bool)> send_streaming_response,
+                      StreamChunkCallback send_streaming_response,
                       std::shared_ptr<HttpSession> session,
                       std::shared_ptr<CancellationToken> cancellation_token) {
-            json request_json;
             rest_handler->handle_models(request_json, send_response, send_streaming_response);
         });
     
     server->register_handler("GET", "/api/version",
         [rest_handler](const http::request<http::string_body>& req,
+                      json& request_json,
+                      const std::vector<std::string_view>& images,
                       std::function<void(const json&)> send_response,
-                      std::function<void(const json&, bool)> send_streaming_response,
+                      StreamChunkCallback send_streaming_response,
                       std::shared_ptr<HttpSession> session,
                       std::shared_ptr<CancellationToken> cancellation_token) {
-            json request_json;
             rest_handler->handle_version(request_json, send_response, send_streaming_response);
         });
     
     // Add NPU status endpoint
     server->register_handler("GET", "/api/npu/status",
         [](const http::request<http::string_body>& req,
+           json& request_json,
+           const std::vector<std::string_view>& images,
            std::function<void(const json&)> send_response,
-           std::function<void(const json&, bool)> send_streaming_response,
+           StreamChunkCallback send_streaming_response,
            std::shared_ptr<HttpSession> session,
            std::shared_ptr<CancellationToken> cancellation_token) {
+            npu_queue_stats stats = NPUAccessManager::get_queue_stats();
             json response = {
                 {"npu_available", NPUAccessManager::is_npu_available()},
                 {"active_requests", NPUAccessManager::get_active_npu_requests()},
+                {"queue", {
+                    {"depth", stats.queue_depth},
+                    {"max_depth", stats.max_queue_depth},
+                    {"admitted", stats.admitted},
+                    {"rejected", stats.rejected},
+                    {"timed_out", stats.timed_out},
+                    {"last_wait_ms", stats.last_wait_us / 1000},
+                    {"max_wait_ms", stats.max_wait_us / 1000},
+                    {"avg_wait_ms", stats.admitted > 0 ? stats.total_wait_us / stats.admitted / 1000 : 0},
+                    {"p50_wait_ms", NPUAccessManager::get_queue_wait_percentile_ms(50)},
+                    {"p90_wait_ms", NPUAccessManager::get_queue_wait_percentile_ms(90)},
+                    {"p99_wait_ms", NPUAccessManager::get_queue_wait_percentile_ms(99)}
+                }},
                 {"message", NPUAccessManager::is_npu_available() ? "NPU is available" : "NPU is currently in use"}
             };
             send_response(response);
@@ -678,27 +1141,23 @@ std::unique_ptr<WebServer> create_lm_server(model_list& models, ModelDownloader&
     // Add other endpoints...
     server->register_handler("POST", "/api/pull",
         [rest_handler](const http::request<http::string_body>& req,
+                      json& request_json,
+                      const std::vector<std::string_view>& images,
                       std::function<void(const json&)> send_response,
-                      std::function<void(const json&, bool)> send_streaming_response,
+                      StreamChunkCallback send_streaming_response,
                       std::shared_ptr<HttpSession> session,
                       std::shared_ptr<CancellationToken> cancellation_token) {
-            json request_json;
-            if (!req.body().empty()) {
-                request_json = json::parse(req.body());
-            }
             rest_handler->handle_pull(request_json, send_response, send_streaming_response);
         });
     
     server->register_handler("POST", "/v1/chat/completions",
         [rest_handler](const http::request<http::string_body>& req,
+                      json& request_json,
+                      const std::vector<std::string_view>& images,
                       std::function<void(const json&)> send_response,
-                      std::function<void(const json&, bool)> send_streaming_response,
+                      StreamChunkCallback send_streaming_response,
                       std::shared_ptr<HttpSession> session,
                       std::shared_ptr<CancellationToken> cancellation_token) {
-            json request_json;
-            if (!req.body().empty()) {
-                request_json = json::parse(req.body());
-            }
             rest_handler->handle_openai_chat_completion(request_json, send_response, send_streaming_response, cancellation_token);
         });
     
@@ -706,14 +1165,12 @@ std::unique_ptr<WebServer> create_lm_server(model_list& models, ModelDownloader&
     WebServer* server_ptr = server.get();
     server->register_handler("POST", "/api/cancel",
         [server_ptr](const http::request<http::string_body>& req,
+                     json& request_json,
+                     const std::vector<std::string_view>& images,
                      std::function<void(const json&)> send_response,
-                     std::function<void(const json&, bool)> send_streaming_response,
+                     StreamChunkCallback send_streaming_response,
                      std::shared_ptr<HttpSession> session,
                      std::shared_ptr<CancellationToken> cancellation_token) {
-            json request_json;
-            if (!req.body().empty()) {
-                request_json = json::parse(req.body());
-            }
             
             if (!request_json.contains("request_id")) {
                 json error_response = {{"error", "request_id is required"}};
@@ -737,5 +1194,51 @@ std::unique_ptr<WebServer> create_lm_server(model_list& models, ModelDownloader&
             send_response(response);
         });
     
+    // Tracing switch, {"enabled": true} starts recording spans, GET /debug/trace exports them
+    server->register_handler("POST", "/debug/trace",
+        [](const http::request<http::string_body>& req,
+           json& request_json,
+           const std::vector<std::string_view>& images,
+           std::function<void(const json&)> send_response,
+           StreamChunkCallback send_streaming_response,
+           std::shared_ptr<HttpSession> session,
+           std::shared_ptr<CancellationToken> cancellation_token) {
+            if (request_json.contains("enabled")) {
+                trace_set_enabled(request_json.value("enabled", false));
+            }
+            json response = {
+                {"enabled", trace_enabled()},
+                {"dropped_spans", trace_dropped_spans()}
+            };
+            send_response(response);
+        });
+    
+    // Runtime log verbosity, {"level": "debug"} changes it, an empty body only reports it
+    server->register_handler("POST", "/api/log",
+        [](const http::request<http::string_body>& req,
+           json& request_json,
+           const std::vector<std::string_view>& images,
+           std::function<void(const json&)> send_response,
+           StreamChunkCallback send_streaming_response,
+           std::shared_ptr<HttpSession> session,
+           std::shared_ptr<CancellationToken> cancellation_token) {
+            if (request_json.contains("level")) {
+                log_level_t level;
+                const json& value = request_json["level"];
+                std::string name = value.is_number_integer() ? std::to_string(value.get<int>()) : value.is_string() ? value.get<std::string>() : "";
+                if (!log_parse_level(name, level)) {
+                    json error_response = {{"error", "level must be one of error, warn, info, debug, trace"}};
+                    send_response(error_response);
+                    return;
+                }
+                log_set_level(level);
+            }
+            json response = {
+                {"level", log_level_name(static_cast<log_level_t>(g_log_level.load()))},
+                {"dropped_lines", log_dropped_lines()}
+            };
+            send_response(response);
+        });
+    
     return server;
 }
\ No newline at end of file
@@ -14,6 +14,7 @@
 #include <boost/asio.hpp>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <functional>
 #include <unordered_map>
@@ -23,9 +24,11 @@
 #include <chrono>
 #include <thread>
 #include <vector>
+#include <condition_variable>
 #include "wstream_buf.hpp"
 #include "streaming_ostream.hpp"
 #include "model_downloader.hpp"
+#include "inference_executor.hpp"
 
 namespace beast = boost::beast;
 namespace http = beast::http;
@@ -45,22 +48,57 @@ extern std::atomic<int> g_npu_active_requests;
 // Helper function to check if an endpoint requires NPU access
 bool requires_npu_access(const std::string& method, const std::string& path);
 
+// Helper function to check if an endpoint runs on the inference executor instead of an I/O thread
+bool runs_on_inference_executor(const std::string& method, const std::string& path);
+
 ///@brief get current time string, format: hh:mm:ss mm:dd:yyyy
 ///@return the current time string
 std::string get_current_time_string();
 
+///@brief result of waiting in the NPU admission queue
+typedef enum {
+    NPU_ADMITTED,
+    NPU_QUEUE_FULL,
+    NPU_QUEUE_TIMEOUT
+} npu_admission_t;
+
+///@brief snapshot of the NPU admission queue statistics
+typedef struct {
+    size_t queue_depth;         // requests currently waiting
+    size_t max_queue_depth;     // configured bound
+    uint64_t admitted;          // requests admitted through the queue
+    uint64_t rejected;          // requests rejected because the queue was full
+    uint64_t timed_out;         // requests that gave up waiting
+    uint64_t last_wait_us;      // wait time of the last admitted request
+    uint64_t max_wait_us;       // longest wait time observed
+    uint64_t total_wait_us;     // accumulated wait time of admitted requests
+} npu_queue_stats;
+
 // NPU access manager class
 class NPUAccessManager {
 public:
     static bool try_acquire_npu_access();
+    ///@brief wait in the admission queue for NPU access
+    ///@param priority higher priority requests are admitted first, FIFO within the same priority
+    ///@param timeout the maximum time to wait in the queue
+    ///@param waited_us the time spent in the queue, in microseconds
+    ///@return NPU_ADMITTED if access is granted, otherwise the reason for rejection
+    static npu_admission_t acquire_npu_access(int priority, std::chrono::milliseconds timeout, uint64_t& waited_us);
     static void release_npu_access();
     static bool is_npu_available();
     static int get_active_npu_requests();
+    static void set_max_queue_depth(size_t depth);
+    static size_t get_queue_depth();
+    static npu_queue_stats get_queue_stats();
+    static double get_queue_wait_percentile_ms(double percentile);
 };
 
 // Stream response callback type for handling streaming responses
 using StreamCallback = std::function<void(const std::string&)>;
 
+// Streaming chunk callback: the pre-formatted bytes of one NDJSON line or SSE event, is_final
+using StreamChunkCallback = std::function<void(std::string_view, bool)>;
+
 // Cancellation token for request cancellation
 struct CancellationToken {
     std::atomic<bool> is_cancelled;
@@ -72,22 +110,24 @@ struct CancellationToken {
         is_cancelled.store(true);
     }
     
-    bool cancelled() const {
-        return is_cancelled.load();
-    }
+    ///@brief true if the request was cancelled or its client went away
+    bool cancelled() const;
 };
 
 // Request handler callback type
 using RequestHandler = std::function<void(
     const http::request<http::string_body>& req,
+    json& request_json,  // the body, parsed once by the server and owned by the request
+    const std::vector<std::string_view>& images,  // base64 messages[*].images[*], views into the request body
     std::function<void(const json&)> send_response,
-    std::function<void(const json&, bool)> send_streaming_response,  // data, is_final
+    StreamChunkCallback send_streaming_response,  // chunk, is_final
     std::shared_ptr<HttpSession> session,  // for streaming support
     std::shared_ptr<CancellationToken> cancellation_token  // for cancellation support
 )>;
 
 
-void brief_print_message_request(nlohmann::json request);
+///@brief print a size-capped summary of a request or response body, the document is not copied
+void brief_print_message_request(const json& request);
 
 class WebServer {
 public:
@@ -101,9 +141,13 @@ public:
     void set_max_connections(size_t max_conns) { max_connections_ = max_conns; }
     void set_request_timeout(std::chrono::seconds timeout) { request_timeout_ = timeout; }
     void set_io_threads(size_t num_threads) { io_thread_count_ = num_threads; }
+    void set_inference_threads(size_t num_threads) { inference_thread_count_ = num_threads; }
     // Maximum accepted HTTP request body size (in bytes)
     void set_max_body_size_bytes(std::size_t bytes) { max_body_size_bytes_ = bytes; }
     std::size_t get_max_body_size_bytes() const { return max_body_size_bytes_; }
+    // NPU admission queue: how many requests may wait and for how long by default
+    void set_npu_queue_depth(size_t depth) { NPUAccessManager::set_max_queue_depth(depth); }
+    void set_npu_queue_timeout(std::chrono::milliseconds timeout) { npu_queue_timeout_ = timeout; }
 
     void register_handler(const std::string& method, const std::string& path, RequestHandler handler);
 
@@ -123,10 +167,30 @@ public:
         std::lock_guard<std::mutex> lock(active_requests_mutex_);
         return active_requests_.size(); 
     }
+    ///@brief render the serving metrics in the Prometheus text format, for GET /metrics
+    std::string render_metrics() const;
 
 private:
     ///@brief do accept
     void do_accept();
+
+    ///@brief run a handler on the inference executor, the response is posted back to the session strand
+    void dispatch_to_executor(const RequestHandler& handler,
+                              const http::request<http::string_body>& req,
+                              json request_json,
+                              std::vector<std::string_view> images,
+                              std::shared_ptr<HttpSession> session,
+                              bool needs_npu);
+
+    ///@brief invoke a handler with callbacks that unregister the request and release the NPU when done
+    ///@param reply writes a complete, non-streaming response
+    void invoke_handler(const RequestHandler& handler,
+                        const http::request<http::string_body>& req,
+                        json& request_json,
+                        const std::vector<std::string_view>& images,
+                        std::shared_ptr<HttpSession> session,
+                        bool needs_npu,
+                        std::function<void(http::status, const json&)> reply);
     
     ///@brief io context
     net::io_context ioc;
@@ -143,8 +207,11 @@ private:
     size_t max_connections_ = 5;
     std::chrono::seconds request_timeout_ = std::chrono::seconds(600); // 5 minutes
     size_t io_thread_count_ = 5;
+    // One worker per connection, so that queued requests wait in the NPU admission queue
+    size_t inference_thread_count_ = 5;
     std::size_t max_body_size_bytes_ = 256ull * 1024 * 1024; // 256 MB default
-    
+    std::chrono::milliseconds npu_queue_timeout_ = std::chrono::milliseconds(300000); // 5 minutes
+
     // Request tracking
     mutable std::mutex active_requests_mutex_;
     mutable std::unordered_map<std::string, std::shared_ptr<CancellationToken>> active_requests_;
@@ -152,6 +219,9 @@ private:
     // Connection tracking
     std::atomic<size_t> active_connections_{0};
     std::vector<std::thread> io_threads_;
+
+    ///@brief runs prefill and decode off the I/O threads
+    InferenceExecutor inference_executor_;
     
     // Friend declaration for HttpSession to access private members
     friend class HttpSession;
@@ -162,14 +232,32 @@ class HttpSession : public std::enable_shared_from_this<HttpSession> {
 public:
     HttpSession(tcp::socket socket, WebServer& server);
     void start();
-    void write_streaming_response(const json& data, bool is_final);
+    ///@brief queue a streaming chunk, safe to call from any thread
+    ///@param chunk the pre-formatted chunk bytes, copied into the write queue
+    ///@note Blocks only while the client is more than a write behind (backpressure)
+    void write_streaming_response(std::string_view chunk, bool is_final);
+    ///@brief mark the current response as produced off the I/O thread
+    void defer_response();
+    ///@brief post a complete response back to the session strand, safe to call from any thread
+    void post_response(http::status status, std::string body, bool retry_later = false);
     void close_connection();
+    ///@brief check whether the client is still connected
+    bool is_client_connected();
+    ///@brief time the current request was completely read
+    std::chrono::steady_clock::time_point request_received_at() const { return request_received_at_; }
 
 private:
     void read_request();
     void handle_request();
     void write_response();
-    void send_chunk_data(const json& data, bool is_final);
+    ///@brief write everything queued since the last write with one async_write, runs on the session strand
+    void flush_stream_writes();
+    ///@brief end the streaming response once the final chunk is written, runs on the session strand
+    void finish_stream();
+    ///@brief periodically probe the socket for a disconnect while the response is being produced
+    void watch_client();
+    void probe_client();
+    void stop_watching_client();
     
     ///@brief socket
     tcp::socket socket_;
@@ -179,12 +267,38 @@ private:
     http::request<http::string_body> req_;
     ///@brief response
     http::response<http::string_body> res_;
+    ///@brief time the current request was completely read
+    std::chrono::steady_clock::time_point request_received_at_;
     ///@brief server
     WebServer& server_;
     ///@brief is streaming
     bool is_streaming_;
+    ///@brief the response is produced on the inference executor
+    bool is_deferred_;
+    ///@brief disconnect probe timer, runs on the session strand
+    net::steady_timer watch_timer_;
     ///@brief stream buffer
     std::shared_ptr<streaming_buf> stream_buf_;
+    ///@brief set once a write fails or the peer closed the connection
+    std::atomic<bool> client_closed_{false};
+
+    // Streaming write queue, chunks arriving while a write is in flight are merged into the next one
+    ///@brief guards the write queue state below
+    std::mutex write_mutex_;
+    ///@brief signalled when the queue drains or the client goes away
+    std::condition_variable write_cv_;
+    ///@brief chunks queued by the producer
+    std::string pending_writes_;
+    ///@brief chunks owned by the in-flight async_write, swapped with pending_writes_ to reuse both buffers
+    std::string inflight_writes_;
+    ///@brief an async_write is in flight
+    bool write_in_flight_ = false;
+    ///@brief a flush is already posted to the strand
+    bool write_scheduled_ = false;
+    ///@brief the chunked response headers are queued
+    bool stream_headers_queued_ = false;
+    ///@brief the terminating chunk is queued
+    bool stream_final_queued_ = false;
 };
 
 // Forward declarations
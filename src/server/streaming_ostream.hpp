@@ -13,11 +13,58 @@
 #include <functional>
 #include <string>
 #include <vector>
+#include <chrono>
+#include <string_view>
 #include <nlohmann/json.hpp>
 #include "chat/chat_bot.hpp"
+#include "chunk_serializer.hpp"
 
 using json = nlohmann::ordered_json;
 
+///@brief Token coalescing window for streamed responses
+///@note A chunk is sent once at least min_tokens flushes are buffered and interval_ms has passed since the last chunk
+///@note The defaults {0, 1} send one chunk per token
+typedef struct {
+    int interval_ms;    // minimum time between chunks, "stream_interval_ms"
+    int min_tokens;     // minimum tokens per chunk, "stream_min_tokens"
+} stream_coalesce_t;
+
+///@brief Decides on every flush whether the buffered text is sent now
+class stream_coalescer {
+public:
+    stream_coalescer(stream_coalesce_t window = {0, 1})
+        : window(window), pending_tokens(0), last_send(std::chrono::steady_clock::now()) {}
+
+    ///@brief Count a flushed token
+    ///@return true if the buffered text should be sent
+    bool on_flush() {
+        pending_tokens++;
+        if (pending_tokens < window.min_tokens) {
+            return false;
+        }
+        if (window.interval_ms <= 0) {
+            return true;
+        }
+        return std::chrono::steady_clock::now() - last_send >= std::chrono::milliseconds(window.interval_ms);
+    }
+
+    ///@brief Reset the window after a chunk was sent
+    void on_send() {
+        pending_tokens = 0;
+        if (window.interval_ms > 0) {
+            last_send = std::chrono::steady_clock::now();
+        }
+    }
+
+private:
+    ///@brief Coalescing window
+    stream_coalesce_t window;
+    ///@brief Tokens flushed since the last chunk
+    int pending_tokens;
+    ///@brief Time of the last chunk
+    std::chrono::steady_clock::time_point last_send;
+};
+
 ///@brief Custom streambuf that captures tokens and sends them immediately
 ///@param model the model
 ///@param callback the callback
@@ -26,11 +73,12 @@ using json = nlohmann::ordered_json;
 ///@note The packet is sent every std::flush, but only when UTF-8 sequences are complete
 class streaming_buf : public std::streambuf {
 public:
-    ///@brief StreamCallback
-    using StreamCallback = std::function<void(const json&, bool)>;
+    ///@brief StreamCallback, receives the bytes of one NDJSON line
+    using StreamCallback = std::function<void(std::string_view, bool)>;
     
-    streaming_buf(const std::string& model, StreamCallback callback, bool is_chat_format = false)
-        : model_name(model), stream_callback(callback), is_chat(is_chat_format) {}
+    streaming_buf(const std::string& model, StreamCallback callback, bool is_chat_format = false, stream_coalesce_t coalesce = {0, 1})
+        : model_name(model), stream_callback(callback), is_chat(is_chat_format), coalescer(coalesce),
+          serializer(is_chat_format ? CHUNK_OLLAMA_CHAT : CHUNK_OLLAMA_GENERATE, model) {}
 
 protected:
     ///@brief Called when buffer is full or flush is requested
@@ -46,31 +94,31 @@ protected:
     ///@brief Called when stream is flushed
     ///@return 0
     int sync() override {
-        flush_complete_utf8_sequences(false);
+        if (coalescer.on_flush()) {
+            flush_complete_utf8_sequences(false);
+        }
         return 0;
     }
 
 public:
     ///@brief Call this when generation is complete
     void finalize_chat(chat_meta_info& meta_info) {
-        // Send all remaining content, including incomplete sequences
+        // Send all remaining content, including incomplete sequences held back by coalescing
         if (!buffer.empty()) {
-            send_response(buffer, true);
+            send_response(buffer, false);
             buffer.clear();
-        } else {
-            send_chat_final_response(meta_info);
         }
+        send_chat_final_response(meta_info);
     }
     ///@brief Call this when generation is complete
     ///@param context the context
     void finalize_generate(chat_meta_info& meta_info, std::vector<int>& context) {
-        // Send all remaining content, including incomplete sequences
+        // Send all remaining content, including incomplete sequences held back by coalescing
         if (!buffer.empty()) {
-            send_response(buffer, true);
+            send_response(buffer, false);
             buffer.clear();
-        } else {
-            send_generate_final_response(meta_info, context);
         }
+        send_generate_final_response(meta_info, context);
     }
 
 private:
@@ -95,7 +143,7 @@ private:
     void flush_complete_utf8_sequences(bool is_final) {
         if (buffer.empty()) return;
         
-        std::string complete_content;
+        complete_content.clear();
         size_t pos = 0;
         
         // Process complete UTF-8 sequences
@@ -123,6 +171,7 @@ private:
         // Send complete sequences if any
         if (!complete_content.empty()) {
             send_response(complete_content, is_final);
+            coalescer.on_send();
         }
         
         // Remove processed bytes from buffer
@@ -135,26 +184,7 @@ private:
     ///@param content the content
     ///@param is_final the is final
     void send_response(const std::string& content, bool is_final) {
-        json response;
-        
-        if (is_chat) {
-            response = {
-                {"model", model_name},
-                {"message", {
-                    {"role", "assistant"},
-                    {"content", content}
-                }},
-                {"done", is_final}
-            };
-        } else {
-            response = {
-                {"model", model_name},
-                {"response", content},
-                {"done", is_final}
-            };
-        }
-        
-        stream_callback(response, is_final);
+        stream_callback(serializer.render_content(content, is_final), is_final);
     }
 
     ///@brief Send the chat final response
@@ -177,7 +207,7 @@ private:
             {"eval_duration", meta_info.decoding_duration}
         };
         
-        stream_callback(response, true);
+        stream_callback(serializer.render_json(response), true);
     }
     
     ///@brief Send the generate final response
@@ -199,7 +229,7 @@ private:
             {"done", true}
         };
         
-        stream_callback(response, true);
+        stream_callback(serializer.render_json(response), true);
     }
     ///@brief Buffer
     std::string buffer;
@@ -209,6 +239,12 @@ private:
     StreamCallback stream_callback;
     ///@brief Is chat
     bool is_chat;
+    ///@brief Token coalescing
+    stream_coalescer coalescer;
+    ///@brief Chunk serializer
+    chunk_serializer serializer;
+    ///@brief Complete UTF-8 sequences of the current chunk, reused across flushes
+    std::string complete_content;
 };
 
 ///@brief Custom ostream for streaming
@@ -218,8 +254,8 @@ private:
 ///@return the streaming ostream
 class streaming_ostream : public std::ostream {
 public:
-    streaming_ostream(const std::string& model, streaming_buf::StreamCallback callback, bool is_chat_format = false)
-        : std::ostream(&buf), buf(model, callback, is_chat_format) {}
+    streaming_ostream(const std::string& model, streaming_buf::StreamCallback callback, bool is_chat_format = false, stream_coalesce_t coalesce = {0, 1})
+        : std::ostream(&buf), buf(model, callback, is_chat_format, coalesce) {}
     
     ///@brief Finalize the chat
     void finalize_chat(chat_meta_info& meta_info) {
@@ -18,6 +18,8 @@
 #include <iomanip>
 #include <nlohmann/json.hpp>
 #include "chat/chat_bot.hpp"
+#include "streaming_ostream.hpp"
+#include "chunk_serializer.hpp"
 
 using json = nlohmann::ordered_json;
 
@@ -29,13 +31,14 @@ using json = nlohmann::ordered_json;
 ///@note The packet is sent every std::flush, but only when UTF-8 sequences are complete
 class streaming_buf_openai : public std::streambuf {
 public:
-    ///@brief StreamCallback
-    using StreamCallback = std::function<void(const std::string&, bool)>;
+    ///@brief StreamCallback, receives the bytes of one SSE event
+    using StreamCallback = std::function<void(std::string_view, bool)>;
     
-    streaming_buf_openai(const std::string& model, StreamCallback callback)
-        : model_name(model), stream_callback(callback), first_chunk(true) {
-        // Generate a unique ID for this stream
-        generate_stream_id();
+    streaming_buf_openai(const std::string& model, StreamCallback callback, stream_coalesce_t coalesce = {0, 1})
+        : model_name(model), stream_callback(callback),
+          // Generate a unique ID for this stream
+          stream_id(generate_stream_id()), first_chunk(true), coalescer(coalesce),
+          serializer(CHUNK_OPENAI_SSE, model, stream_id) {
     }
 
 protected:
@@ -52,16 +55,18 @@ protected:
     ///@brief Called when stream is flushed
     ///@return 0
     int sync() override {
-        flush_complete_utf8_sequences(false);
+        if (coalescer.on_flush()) {
+            flush_complete_utf8_sequences(false);
+        }
         return 0;
     }
 
 public:
     ///@brief Call this when generation is complete
     void finalize(chat_meta_info& meta_info) {
-        // Send all remaining content, including incomplete sequences
+        // Send all remaining content, including incomplete sequences held back by coalescing
         if (!buffer.empty()) {
-            send_response(buffer, true);
+            send_response(buffer, false);
             buffer.clear();
         }
         send_final_response(meta_info);
@@ -70,7 +75,8 @@ public:
 
 private:
     ///@brief Generate a unique stream ID
-    void generate_stream_id() {
+    ///@return the stream ID
+    static std::string generate_stream_id() {
         std::random_device rd;
         std::mt19937 gen(rd());
         std::uniform_int_distribution<> dis(0, 15);
@@ -80,7 +86,7 @@ private:
         for (int i = 0; i < 24; ++i) {
             ss << std::hex << dis(gen);
         }
-        stream_id = ss.str();
+        return ss.str();
     }
     
     ///@brief Get UTF-8 sequence length from first byte
@@ -104,7 +110,7 @@ private:
     void flush_complete_utf8_sequences(bool is_final) {
         if (buffer.empty()) return;
         
-        std::string complete_content;
+        complete_content.clear();
         size_t pos = 0;
         
         // Process complete UTF-8 sequences
@@ -132,6 +138,7 @@ private:
         // Send complete sequences if any
         if (!complete_content.empty()) {
             send_response(complete_content, is_final);
+            coalescer.on_send();
         }
         
         // Remove processed bytes from buffer
@@ -144,11 +151,9 @@ private:
     ///@param content the content
     ///@param is_final the is final
     void send_response(const std::string& content, bool is_final) {
-        json response;
-        
         if (first_chunk) {
             // First chunk with role
-            response = {
+            json response = {
                 {"id", stream_id},
                 {"object", "chat.completion.chunk"},
                 {"choices", json::array({
@@ -162,25 +167,11 @@ private:
                 })}
             };
             first_chunk = false;
-            stream_callback("data: " + response.dump() + "\n\n", false);
+            stream_callback(serializer.render_json(response), false);
         }
         
         // Content chunk
-        response = {
-            {"id", stream_id},
-            {"object", "chat.completion.chunk"},
-            {"choices", json::array({
-                {
-                    {"delta", {
-                        {"content", content}
-                    }},
-                    {"index", 0}
-                }
-            })}
-        };
-        
-        stream_callback("data: " + response.dump() + "\n\n", is_final);
-      
+        stream_callback(serializer.render_content(content), is_final);
     }
 
     ///@brief Send the chat final response
@@ -199,7 +190,7 @@ private:
                     }
                 })}
             };
-            stream_callback("data: " + response.dump() + "\n\n", false);
+            stream_callback(serializer.render_json(response), false);
         }
         
         // Send final chunk with finish_reason only (no empty delta)
@@ -216,10 +207,13 @@ private:
             {"usage", {
                 {"prompt_tokens", meta_info.prompt_tokens},
                 {"completion_tokens", meta_info.generated_tokens},
-                {"total_tokens", meta_info.prompt_tokens + meta_info.generated_tokens}
+                {"total_tokens", meta_info.prompt_tokens + meta_info.generated_tokens},
+                {"prompt_tokens_details", {
+                    {"cached_tokens", meta_info.cached_tokens}
+                }}
             }}
         };
-        stream_callback("data: " + final_response.dump() + "\n\n", false);
+        stream_callback(serializer.render_json(final_response), false);
         // Send the [DONE] message
         stream_callback("data: [DONE]\n\n", true);
     }
@@ -235,6 +229,12 @@ private:
     std::string stream_id;
     ///@brief First chunk flag
     bool first_chunk;
+    ///@brief Token coalescing
+    stream_coalescer coalescer;
+    ///@brief Chunk serializer
+    chunk_serializer serializer;
+    ///@brief Complete UTF-8 sequences of the current chunk, reused across flushes
+    std::string complete_content;
 };
 
 ///@brief Custom ostream for streaming
@@ -244,8 +244,8 @@ private:
 ///@return the streaming ostream
 class streaming_ostream_openai : public std::ostream {
 public:
-    streaming_ostream_openai(const std::string& model, streaming_buf_openai::StreamCallback callback)
-        : std::ostream(&buf), buf(model, callback) {}
+    streaming_ostream_openai(const std::string& model, streaming_buf_openai::StreamCallback callback, stream_coalesce_t coalesce = {0, 1})
+        : std::ostream(&buf), buf(model, callback, coalesce) {}
     
     ///@brief Finalize the chat
     void finalize(chat_meta_info& meta_info) {
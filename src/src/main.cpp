@@ -9,7 +9,9 @@
 #include "server.hpp"
 #include "model_list.hpp"
 #include "model_downloader.hpp"
+#include "tensor_utils/model_converter.hpp"
 #include "utils/utils.hpp"
+#include "utils/trace.hpp"
 #include "minja/chat-template.hpp"
 #include <iostream>
 #include <string>
@@ -144,6 +146,27 @@ int get_server_port() {
     return 11434; // Default port
 }
 
+///@brief get_npu_queue_depth gets how many requests may wait for the NPU from environment variable FLM_NPU_QUEUE_DEPTH
+///@param default_depth the depth if the environment variable is not set or invalid
+///@return the queue depth
+size_t get_npu_queue_depth(size_t default_depth) {
+    char* depth_env = nullptr;
+    size_t len = 0;
+    if (_dupenv_s(&depth_env, &len, "FLM_NPU_QUEUE_DEPTH") == 0 && depth_env != nullptr) {
+        try {
+            int depth = std::stoi(depth_env);
+            free(depth_env);
+            if (depth >= 0) {
+                return (size_t)depth;
+            }
+        } catch (const std::exception&) {
+            free(depth_env);
+            // Invalid depth, use default
+        }
+    }
+    return default_depth;
+}
+
 ///@brief get_models_directory gets the models directory from environment variable or defaults to Documents
 ///@return the models directory path
 std::string get_models_directory() {
@@ -168,6 +191,8 @@ std::string get_models_directory() {
 int main(int argc, char* argv[]) {
     SetConsoleOutputCP(CP_UTF8);
     SetConsoleCP(CP_UTF8);
+    log_init_from_env();   // FLM_LOG_LEVEL=error|warn|info|debug|trace
+    trace_init_from_env(); // FLM_TRACE=1, FLM_TRACE_DIR=<dir> for one trace file per request
     
     // Get Unicode command line arguments
     int unicode_argc;
@@ -180,6 +205,9 @@ int main(int argc, char* argv[]) {
     bool force_redownload = false;
     std::string power_mode = "performance"; // Default power mode
     bool got_power_mode = false;
+    std::string convert_input;
+    std::string convert_output;
+    model_convert_options_t convert_options;
     
     // Parse the command line arguments
     if (unicode_argc < 2) {
@@ -252,6 +280,38 @@ int main(int argc, char* argv[]) {
         }
         tag = unicode_argv[2];
     }
+    else if (command == "convert") {
+        // Experimental and not listed in the help, the output is not a model.q4nx that run or serve can load
+        bool experimental = false;
+        std::vector<std::string> paths;
+        try {
+            for (int i = 2; i < unicode_argc; i++) {
+                if (unicode_argv[i] == "--experimental") {
+                    experimental = true;
+                }
+                else if (unicode_argv[i] == "--threads" && i + 1 < unicode_argc) {
+                    convert_options.threads = std::stoi(unicode_argv[i + 1]);
+                    i++;
+                }
+                else {
+                    paths.push_back(unicode_argv[i]);
+                }
+            }
+        } catch (const std::exception&) {
+            std::cout << "Invalid number for --threads" << std::endl;
+            return 1;
+        }
+        if (!experimental) {
+            std::cout << "convert is experimental, its output cannot be loaded by run or serve. Pass --experimental to use it anyway" << std::endl;
+            return 1;
+        }
+        if (paths.size() != 2) {
+            std::cout << "Usage: " << unicode_argv[0] << " convert --experimental <input> <output> [--threads <n>]" << std::endl;
+            return 1;
+        }
+        convert_input = paths[0];
+        convert_output = paths[1];
+    }
     else if (command == "list") {
         if (unicode_argc < 2) {
             std::cout << "Usage: " << unicode_argv[0] << " list" << std::endl;
@@ -259,6 +319,21 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    // Convert works on a checkpoint on disk, it needs neither the NPU nor the model list
+    if (command == "convert") {
+        try {
+            ShardedSafeTensors input(convert_input);
+            ModelConverter converter(input, convert_options);
+            model_convert_stats_t stats = converter.convert(convert_output);
+            ModelConverter::print_stats(stats);
+            std::cout << "Note: " << convert_output << " is an int4 safetensors checkpoint, flm run and flm serve cannot load it" << std::endl;
+            return 0;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
     // Set process priority to high for better performance
     SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS);
     
@@ -336,11 +411,21 @@ int main(int argc, char* argv[]) {
             // Create the server
             int port = get_server_port();
             auto server = create_lm_server(supported_models, downloader, tag, port);
-            server->set_max_connections(5);           // Allow up to 2000 concurrent connections
+            const size_t max_connections = 5;
+            server->set_max_connections(max_connections);           // Allow up to 5 concurrent connections
             server->set_io_threads(5);          // Allow up to 5 io threads
+            server->set_inference_threads(max_connections);   // One inference worker per connection
             server->set_request_timeout(std::chrono::seconds(600)); // 10 minute timeout for long requests
+            // One connection holds the NPU and the others may wait, a smaller FLM_NPU_QUEUE_DEPTH answers the rest with 503
+            size_t npu_queue_depth = get_npu_queue_depth(max_connections - 1);
+            if (npu_queue_depth >= max_connections) {
+                header_print("WARNING", "FLM_NPU_QUEUE_DEPTH " << npu_queue_depth << " is never reached, at most " << max_connections - 1 << " requests can wait with " << max_connections << " connections");
+            }
+            server->set_npu_queue_depth(npu_queue_depth);
+            server->set_npu_queue_timeout(std::chrono::minutes(5)); // Give up waiting for the NPU after 5 minutes
             // Start the server
             header_print("FLM", "Starting server on port " << port << "...");
+            log_start_async();   // Request threads only enqueue log lines from here on
             server->start();
 
             // Start a thread to handle user input, this thread will be used to handle the user input
@@ -355,6 +440,7 @@ int main(int argc, char* argv[]) {
             header_print("FLM", "Stopping server...");
             server->stop();
             input_thread.join();
+            log_stop_async();
         }
         else if (command == "pull") {
             // Check if the model is already downloaded, if true, the model will not be downloaded